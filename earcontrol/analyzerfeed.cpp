@@ -0,0 +1,65 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "analyzerfeed.h"
+
+const float AnalyzerFeed::LEVEL_FLOOR = -120.0f;
+
+AnalyzerFeed::AnalyzerFeed() {
+    _ringBuffer = jack_ringbuffer_create(RING_BUFFER_FRAMES * sizeof(Frame));
+    jack_ringbuffer_mlock(_ringBuffer);
+    _frame.m_bands = 0;
+    _samplesSinceFrame = 0;
+    _active.store(false);
+}
+
+AnalyzerFeed::~AnalyzerFeed() {
+    jack_ringbuffer_free(_ringBuffer);
+}
+
+void AnalyzerFeed::setActive(bool on) {
+    _active.store(on);
+}
+
+AnalyzerFeed::Frame *AnalyzerFeed::beginFrame(int samples, int sampleRate) {
+    if(!active())
+        return 0;
+
+    _samplesSinceFrame += samples;
+    if(_samplesSinceFrame < sampleRate / FRAME_RATE)
+        return 0;
+
+    if(jack_ringbuffer_write_space(_ringBuffer) < sizeof(Frame))
+        return 0;
+
+    _samplesSinceFrame = 0;
+    return &_frame;
+}
+
+void AnalyzerFeed::publishFrame() {
+    jack_ringbuffer_write(_ringBuffer, (const char*)&_frame, sizeof(Frame));
+}
+
+bool AnalyzerFeed::readFrame(Frame *frame) {
+    if(jack_ringbuffer_read_space(_ringBuffer) < sizeof(Frame))
+        return false;
+    jack_ringbuffer_read(_ringBuffer, (char*)frame, sizeof(Frame));
+    return true;
+}
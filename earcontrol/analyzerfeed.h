@@ -0,0 +1,114 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ANALYZERFEED_H
+#define ANALYZERFEED_H
+
+#include <QAtomicInt>
+
+// JACK includes:
+#include <jack/ringbuffer.h>
+
+#include "controlgrid.h"
+
+/**
+ * @class AnalyzerFeed
+ *
+ * @author Jacob Dawid ( jacob@omg-it.works )
+ * @author Otto Ritter ( otto.ritter.or@googlemail.com )
+ * @date 09.2011-2016
+ *
+ * @brief Hands the spectra of the adaption over to the analyzer view.
+ *
+ * The process callback publishes the band spectra it has estimated for the
+ * adaption, at most FRAME_RATE times per second, through a lock-free ring
+ * buffer of frames. While the feed is active, the spectra are estimated
+ * even if automatic adaption is off. If the GUI falls behind, frames are
+ * dropped.
+ */
+class AnalyzerFeed {
+public:
+    /** Maximum number of frames published per second. */
+    static const int FRAME_RATE = 30;
+
+    /** Level in dB of silent bands. */
+    static const float LEVEL_FLOOR;
+
+    /** Spectra of one analysis frame, all levels in dB. */
+    struct Frame {
+        /** Grid of the bands. */
+        int m_bandsPerOctave;
+        int m_sampleRate;
+        int m_bands;
+        /** Averaged power of the reference signal. */
+        float m_referenceLevel[ControlGrid::MAX_BANDS];
+        /** Averaged power of the measured signal. */
+        float m_measuredLevel[ControlGrid::MAX_BANDS];
+        /** Estimated transfer function, LEVEL_FLOOR where the reference
+          * is silent. */
+        float m_transferLevel[ControlGrid::MAX_BANDS];
+    };
+
+    AnalyzerFeed();
+    ~AnalyzerFeed();
+
+    /** Starts or stops publishing frames. */
+    void setActive(bool on);
+
+    /** @return True, if frames are published. */
+    bool active() { return _active.load(); }
+
+    /**
+      * Counts the samples of a period and tells whether a frame is due.
+      * Safe to call from the process callback.
+      * @param samples Number of samples of the period.
+      * @param sampleRate Sample rate.
+      * @return Frame to fill and publish with publishFrame(), or null if
+      *         there is no frame due or no room for it.
+      */
+    Frame *beginFrame(int samples, int sampleRate);
+
+    /** Publishes the frame returned by beginFrame(). */
+    void publishFrame();
+
+    /**
+      * Takes the oldest published frame out of the ring buffer.
+      * @param frame Receives the frame.
+      * @return false, if there is no frame.
+      */
+    bool readFrame(Frame *frame);
+
+private:
+    /** Number of frames the ring buffer holds. */
+    static const int RING_BUFFER_FRAMES = 8;
+
+    jack_ringbuffer_t *_ringBuffer;
+
+    /** Frame being filled by the process callback. */
+    Frame _frame;
+
+    /** Samples processed since the last frame. */
+    int _samplesSinceFrame;
+
+    /** Publishing state, shared with the GUI. */
+    QAtomicInt _active;
+};
+
+#endif // ANALYZERFEED_H
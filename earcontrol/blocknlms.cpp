@@ -0,0 +1,121 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "blocknlms.h"
+
+#include <QtGlobal>
+
+#include <cmath>
+
+const double BlockNLMS::STEP_SIZE = 0.5;
+const double BlockNLMS::POWER_WEIGHT = 0.2;
+const double BlockNLMS::POWER_FLOOR = 1e-12;
+
+BlockNLMS::BlockNLMS() {
+    reset();
+}
+
+void BlockNLMS::reset() {
+    _bands = 0;
+    _frameSize = 0;
+    for(int i = 0; i < MAX_BINS; i++) {
+        _correction[i][0] = 1.0;
+        _correction[i][1] = 0.0;
+        _measuredPower[i] = 0.0;
+    }
+}
+
+void BlockNLMS::update(const fftw_complex *reference, const fftw_complex *measured,
+                       const ControlGrid::BinRange *ranges, int bands, int frameSize) {
+    if(bands <= 0 || frameSize / 2 + 1 > MAX_BINS)
+        return;
+    if(bands != _bands || frameSize != _frameSize) {
+        reset();
+        _bands = bands;
+        _frameSize = frameSize;
+    }
+    for(int i = 0; i < bands; i++)
+        _ranges[i] = ranges[i];
+
+    const double scale = 1.0 / ((double)frameSize * frameSize);
+
+    // Neighbouring bands may share a bin, so adapt each bin once.
+    for(int j = ranges[0].first; j <= ranges[bands - 1].last; j++) {
+        // The gradient is conj(Y) * X - W * |Y|^2.
+        double xr = reference[j][0], xi = reference[j][1];
+        double yr = measured[j][0], yi = measured[j][1];
+        double power = (yr * yr + yi * yi) * scale;
+        double crossReal = (yr * xr + yi * xi) * scale;
+        double crossImaginary = (yr * xi - yi * xr) * scale;
+
+        _measuredPower[j] += POWER_WEIGHT * (power - _measuredPower[j]);
+
+        // Normalizing by the smoothed power alone would take steps of up to
+        // mu / POWER_WEIGHT at a signal onset, beyond the stability bound
+        // of 2. The current power keeps the step at mu or below.
+        double normalization = qMax(_measuredPower[j], power);
+        if(normalization < POWER_FLOOR)
+            continue;
+
+        // W += mu / P * (conj(Y) * X - W * |Y|^2)
+        double wr = _correction[j][0], wi = _correction[j][1];
+        double step = STEP_SIZE / normalization;
+        _correction[j][0] += step * (crossReal - wr * power);
+        _correction[j][1] += step * (crossImaginary - wi * power);
+    }
+}
+
+void BlockNLMS::transferTo(double *controls, int bands, double share,
+                           double minimum, double maximum) {
+    for(int i = 0; i < bands && i < _bands; i++) {
+        // Average the magnitudes, not the corrections, as their phases
+        // differ from bin to bin.
+        double powerSum = 0.0, magnitudeSum = 0.0;
+        for(int j = _ranges[i].first; j <= _ranges[i].last; j++) {
+            if(_measuredPower[j] < POWER_FLOOR)
+                continue;
+            powerSum += _measuredPower[j];
+            magnitudeSum += _measuredPower[j] * sqrt(_correction[j][0] * _correction[j][0]
+                                                   + _correction[j][1] * _correction[j][1]);
+        }
+        if(powerSum <= 0.0 || magnitudeSum <= 0.0)
+            continue;
+        double magnitude = magnitudeSum / powerSum;
+
+        double control = controls[i] * pow(magnitude, share);
+        if(control < minimum)
+            control = minimum;
+        if(control > maximum)
+            control = maximum;
+
+        // The measured signal will be scaled by the change of the control,
+        // so the corrections of the band need to be scaled inversely. A bin
+        // shared with the previous band has been scaled already.
+        double change = control / controls[i];
+        int first = _ranges[i].first;
+        if(i > 0 && first <= _ranges[i - 1].last)
+            first = _ranges[i - 1].last + 1;
+        for(int j = first; j <= _ranges[i].last; j++) {
+            _correction[j][0] /= change;
+            _correction[j][1] /= change;
+        }
+        controls[i] = control;
+    }
+}
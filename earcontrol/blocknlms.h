@@ -0,0 +1,108 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BLOCKNLMS_H
+#define BLOCKNLMS_H
+
+// FFTW3 includes:
+#include "fftw3.h"
+
+#include "controlgrid.h"
+#include "dspkernels.h"
+
+/**
+ * @class BlockNLMS
+ *
+ * @author Jacob Dawid ( jacob@omg-it.works )
+ * @author Otto Ritter ( otto.ritter.or@googlemail.com )
+ * @date 09.2011-2016
+ *
+ * @brief Frequency domain block NLMS adaption of the equalizer.
+ *
+ * Adapts a correction W per bin, so that W times the measured spectrum
+ * matches the reference spectrum. A single correction per band could not
+ * follow the phase of the room, which changes from bin to bin within wide
+ * bands. Each bin has its own step size, normalized by the averaged power
+ * of the measured signal, so all bins converge equally fast regardless of
+ * the spectrum of the music.
+ *
+ * The magnitude of the correction, averaged over the bins of a band and
+ * weighted by their power, is moved into the equalizer controls bit by
+ * bit. Whatever is moved into a control is divided out of the corrections
+ * of its bins, so they keep describing the remaining error of the
+ * equalized signal.
+ */
+class BlockNLMS {
+public:
+    /** Normalized step size, between 0 and 2. */
+    static const double STEP_SIZE;
+
+    /** Weight of a new frame in the averaged power. */
+    static const double POWER_WEIGHT;
+
+    /** Normalized power below which a bin is not adapted. */
+    static const double POWER_FLOOR;
+
+    /** Largest number of bins of the spectra. */
+    static const int MAX_BINS = DSPKernels::MAX_BLOCK_SIZE / 2 + 1;
+
+    BlockNLMS();
+
+    /** Resets the correction to unity. */
+    void reset();
+
+    /** @return Number of bands adapted, zero after reset. */
+    int bands() const { return _bands; }
+
+    /**
+      * Adapts the correction to one frame. Resets if the number of bands
+      * or the frame size has changed.
+      * @param reference Spectrum of the reference signal.
+      * @param measured Spectrum of the measured signal.
+      * @param ranges Bins of each band, in ascending order.
+      * @param bands Number of bands.
+      * @param frameSize Number of samples the spectra have been taken from.
+      */
+    void update(const fftw_complex *reference, const fftw_complex *measured,
+                const ControlGrid::BinRange *ranges, int bands, int frameSize);
+
+    /**
+      * Moves a share of the correction magnitude into the controls.
+      * @param controls Equalizer controls, one per band.
+      * @param bands Number of controls to update.
+      * @param share Exponent of the magnitude moved, between 0 and 1.
+      * @param minimum Lower limit for the controls.
+      * @param maximum Upper limit for the controls.
+      */
+    void transferTo(double *controls, int bands, double share,
+                    double minimum, double maximum);
+
+private:
+    int _bands;
+    int _frameSize;
+
+    /** Ranges of the bands the corrections have been adapted with. */
+    ControlGrid::BinRange _ranges[ControlGrid::MAX_BANDS];
+
+    fftw_complex _correction[MAX_BINS];
+    double _measuredPower[MAX_BINS];
+};
+
+#endif // BLOCKNLMS_H
@@ -0,0 +1,117 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "channelarena.h"
+
+#include <QtGlobal>
+#include <QDebug>
+
+#include <string.h>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+bool ChannelArena::_hugePagesEnabled = false;
+
+#ifdef Q_OS_UNIX
+/** Size of the pages backing a block. */
+static size_t pageSize(bool hugePages) {
+    return hugePages ? 2 * 1024 * 1024 : (size_t)sysconf(_SC_PAGESIZE);
+}
+
+/** Rounds the size up to a multiple of the page size. */
+static size_t mappedSize(size_t size, bool hugePages) {
+    size_t page = pageSize(hugePages);
+    return (size + page - 1) / page * page;
+}
+#endif
+
+void *ChannelArena::allocate(size_t size) {
+    void *memory = 0;
+
+#ifdef Q_OS_UNIX
+    // Mappings are page aligned and thus cache line aligned as well.
+    // Remember whether we got huge pages at the start of the block, so that
+    // the block can be unmapped with the right size later.
+    bool hugePages = false;
+#ifdef MAP_HUGETLB
+    if(_hugePagesEnabled) {
+        memory = mmap(0, mappedSize(size + CACHE_LINE_SIZE, true),
+                      PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(memory == MAP_FAILED) {
+            qDebug() << "Could not allocate huge pages, falling back to regular pages.";
+            memory = 0;
+        } else {
+            hugePages = true;
+        }
+    }
+#endif
+    if(!memory) {
+        memory = mmap(0, mappedSize(size + CACHE_LINE_SIZE, false),
+                      PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(memory == MAP_FAILED)
+            return 0;
+    }
+
+    size_t totalSize = mappedSize(size + CACHE_LINE_SIZE, hugePages);
+    if(mlock(memory, totalSize) != 0) {
+        qDebug() << "Could not lock channel memory, consider raising the memlock limit.";
+    }
+
+    // Touch every page, so that all page faults happen right now.
+    memset(memory, 0, totalSize);
+
+    // The first cache line keeps track of how the block has been mapped.
+    *(bool*)memory = hugePages;
+    return (char*)memory + CACHE_LINE_SIZE;
+#else
+    memory = qMallocAligned(size, CACHE_LINE_SIZE);
+    if(memory)
+        memset(memory, 0, size);
+    return memory;
+#endif
+}
+
+void ChannelArena::release(void *memory, size_t size) {
+    if(!memory)
+        return;
+
+#ifdef Q_OS_UNIX
+    char *block = (char*)memory - CACHE_LINE_SIZE;
+    size_t totalSize = mappedSize(size + CACHE_LINE_SIZE, *(bool*)block);
+    munlock(block, totalSize);
+    munmap(block, totalSize);
+#else
+    Q_UNUSED(size);
+    qFreeAligned(memory);
+#endif
+}
+
+void ChannelArena::setHugePagesEnabled(bool on) {
+    _hugePagesEnabled = on;
+}
+
+bool ChannelArena::hugePagesEnabled() {
+    return _hugePagesEnabled;
+}
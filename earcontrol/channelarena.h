@@ -0,0 +1,64 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHANNELARENA_H
+#define CHANNELARENA_H
+
+#include <stddef.h>
+
+/**
+  * @class ChannelArena
+  * @author Jacob Dawid ( jacob@omg-it.works )
+  * Allocates the working set of a channel as one contiguous block. The
+  * block is aligned to the cache line size, locked into memory and
+  * pre-faulted, so that the process callback does not run into page
+  * faults after a channel has been created.
+  */
+class ChannelArena {
+public:
+    /** Cache line size the arena blocks are aligned to. */
+    static const size_t CACHE_LINE_SIZE = 64;
+
+    /**
+      * Allocates a block of memory. The memory is zeroed.
+      * @param size Size of the block in bytes.
+      * @return Pointer to the block, or null if out of memory.
+      */
+    static void *allocate(size_t size);
+
+    /**
+      * Releases a block that has been allocated with allocate.
+      * @param memory Pointer to the block.
+      * @param size Size of the block in bytes, as passed to allocate.
+      */
+    static void release(void *memory, size_t size);
+
+    /** Enables or disables backing new blocks with huge pages. Falls back
+      * to regular pages if no huge pages are available. Off by default. */
+    static void setHugePagesEnabled(bool on);
+
+    /** @return true, if new blocks will be backed by huge pages. */
+    static bool hugePagesEnabled();
+
+private:
+    static bool _hugePagesEnabled;
+};
+
+#endif // CHANNELARENA_H
@@ -0,0 +1,113 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "controlgrid.h"
+
+#include <cmath>
+
+const double ControlGrid::LOWEST_FREQUENCY = 20.0;
+
+ControlGrid::ControlGrid() {
+    setup(12, 44100);
+}
+
+void ControlGrid::setup(int bandsPerOctave, int sampleRate) {
+    _bandsPerOctave = bandsPerOctave < 3 ? 3 : (bandsPerOctave > 24 ? 24 : bandsPerOctave);
+    _sampleRate = sampleRate;
+
+    double octaves = log2(_sampleRate / 2.0 / LOWEST_FREQUENCY);
+    _bands = (int)floor(octaves * _bandsPerOctave) + 1;
+    if(_bands > MAX_BANDS)
+        _bands = MAX_BANDS;
+    if(_bands < 2)
+        _bands = 2;
+}
+
+double ControlGrid::frequency(int band) const {
+    return LOWEST_FREQUENCY * pow(2.0, (double)band / _bandsPerOctave);
+}
+
+double ControlGrid::position(double frequency) const {
+    if(frequency <= 0.0)
+        return -1.0;
+    return log2(frequency / LOWEST_FREQUENCY) * _bandsPerOctave;
+}
+
+void ControlGrid::binRanges(double binWidth, int bins, BinRange *ranges) const {
+    // Band edges lie halfway between the centers on the logarithmic axis.
+    double halfBand = pow(2.0, 0.5 / _bandsPerOctave);
+    for(int i = 0; i < _bands; i++) {
+        double center = frequency(i);
+        int first = i == 0 ? 0 : (int)ceil(center / halfBand / binWidth);
+        int last = i == _bands - 1 ? bins - 1 : (int)ceil(center * halfBand / binWidth) - 1;
+
+        if(first > bins - 1)
+            first = bins - 1;
+        if(last > bins - 1)
+            last = bins - 1;
+
+        if(first > last) {
+            int nearest = (int)floor(center / binWidth + 0.5);
+            first = last = nearest < bins ? nearest : bins - 1;
+        }
+
+        ranges[i].first = first;
+        ranges[i].last = last;
+    }
+}
+
+void ControlGrid::interpolationWeights(double binWidth, int bins, int *band, double *weight) const {
+    for(int i = 0; i < bins; i++) {
+        double p = position(i * binWidth);
+        if(p <= 0.0) {
+            band[i] = 0;
+            weight[i] = 0.0;
+        } else if(p >= _bands - 1) {
+            band[i] = _bands - 2;
+            weight[i] = 1.0;
+        } else {
+            band[i] = (int)floor(p);
+            weight[i] = p - band[i];
+        }
+    }
+}
+
+double ControlGrid::interpolate(const double *values, double frequency) const {
+    double p = position(frequency);
+    if(p <= 0.0)
+        return values[0];
+    if(p >= _bands - 1)
+        return values[_bands - 1];
+
+    int band = (int)floor(p);
+    double weight = p - band;
+    return (1.0 - weight) * values[band] + weight * values[band + 1];
+}
+
+void ControlGrid::reduce(const double *spectrum, double binWidth, int bins, double *values) const {
+    BinRange ranges[MAX_BANDS];
+    binRanges(binWidth, bins, ranges);
+    for(int i = 0; i < _bands; i++) {
+        double sum = 0.0;
+        for(int j = ranges[i].first; j <= ranges[i].last; j++)
+            sum += spectrum[j];
+        values[i] = sum / (ranges[i].last - ranges[i].first + 1);
+    }
+}
@@ -0,0 +1,110 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONTROLGRID_H
+#define CONTROLGRID_H
+
+/**
+ * @class ControlGrid
+ *
+ * @author Jacob Dawid ( jacob@omg-it.works )
+ * @author Otto Ritter ( otto.ritter.or@googlemail.com )
+ * @date 09.2011-2016
+ *
+ * @brief Fractional octave bands the equalizer controls are placed on.
+ *
+ * The bands start at LOWEST_FREQUENCY and are spaced evenly on a
+ * logarithmic frequency axis up to the nyquist frequency. Spectra with
+ * linearly spaced bins are mapped onto the bands by averaging the bins of
+ * each band, and band values are mapped back onto bins by interpolating
+ * between neighbouring bands on the logarithmic axis.
+ */
+class ControlGrid {
+public:
+    /** Maximum number of bands, enough for 1/24 octave at 192 kHz. */
+    static const int MAX_BANDS = 512;
+
+    /** Center frequency of the lowest band in Hz. */
+    static const double LOWEST_FREQUENCY;
+
+    /** Range of bins belonging to a band, both inclusive. */
+    struct BinRange {
+        int first;
+        int last;
+    };
+
+    ControlGrid();
+
+    /**
+      * Sets up the bands.
+      * @param bandsPerOctave Bands per octave, between 3 and 24.
+      * @param sampleRate Sample rate in Hz.
+      */
+    void setup(int bandsPerOctave, int sampleRate);
+
+    int bands() const { return _bands; }
+    int bandsPerOctave() const { return _bandsPerOctave; }
+    int sampleRate() const { return _sampleRate; }
+
+    /** @return Center frequency of the band in Hz. */
+    double frequency(int band) const;
+
+    /**
+      * Finds the bins of a linearly spaced spectrum belonging to each band.
+      * Bands narrower than a bin get the bin closest to their center.
+      * @param binWidth Frequency distance between two bins in Hz.
+      * @param bins Number of bins, the first bin is at 0 Hz.
+      * @param ranges Receives bands() ranges.
+      */
+    void binRanges(double binWidth, int bins, BinRange *ranges) const;
+
+    /**
+      * Calculates how to interpolate band values onto the bins of a linearly
+      * spaced spectrum. The value of bin i is (1 - weight[i]) times the value
+      * of band[i] plus weight[i] times the value of band[i] + 1.
+      * @param binWidth Frequency distance between two bins in Hz.
+      * @param bins Number of bins, the first bin is at 0 Hz.
+      * @param band Receives the lower band for each bin.
+      * @param weight Receives the weight of the upper band for each bin.
+      */
+    void interpolationWeights(double binWidth, int bins, int *band, double *weight) const;
+
+    /** @return The band values interpolated at the given frequency. */
+    double interpolate(const double *values, double frequency) const;
+
+    /**
+      * Averages a linearly spaced spectrum into the bands.
+      * @param spectrum Values of the bins.
+      * @param binWidth Frequency distance between two bins in Hz.
+      * @param bins Number of bins, the first bin is at 0 Hz.
+      * @param values Receives bands() values.
+      */
+    void reduce(const double *spectrum, double binWidth, int bins, double *values) const;
+
+private:
+    /** @return Position on the band axis for a frequency, not limited. */
+    double position(double frequency) const;
+
+    int _bandsPerOctave;
+    int _sampleRate;
+    int _bands;
+};
+
+#endif // CONTROLGRID_H
@@ -20,15 +20,36 @@
 
 #include "dspcore.h"
 #include "semaphorelocker.h"
+#include "filterbankbuilder.h"
 
 #include <cmath>
 
 #include <QDebug>
+#include <QThreadPool>
 
 DSPCore::DSPCore(QtJack::Client& client)
     : Processor(client),
       _client(client) {
     _earFiltersSemaphore = new QSemaphore(1);
+    _noiseSeed = DEFAULT_NOISE_SEED;
+
+    _analysisBatch = 0;
+    _requestedAnalysisSize.store(_client.bufferSize());
+
+    _parallelCalibration = 0;
+
+    // The FFTW planner is neither real-time safe nor thread-safe, so the
+    // process callback leaves planning to us.
+    startTimer(PLANNING_INTERVAL);
+}
+
+DSPCore::~DSPCore() {
+    // Filter bank builders refer to the equalizers.
+    QThreadPool::globalInstance()->waitForDone();
+
+    delete _parallelCalibration;
+    destroyAnalysisBatch(_analysisBatch);
+    delete _earFiltersSemaphore;
 }
 
 QtJack::Client& DSPCore::client() {
@@ -37,8 +58,45 @@ QtJack::Client& DSPCore::client() {
 
 void DSPCore::process(int samples) {
     SemaphoreLocker locker(_earFiltersSemaphore);
-    foreach(EARFilter *earFilter, _earFilters) {
-        earFilter->process(samples);
+    if(_earFilters.isEmpty())
+        return;
+
+    // Until the analysis has been planned for a new period size, the
+    // channels go without spectra.
+    AnalysisBatch *batch = _analysisBatch;
+    bool planned = batch->m_plan && batch->m_samples == samples;
+    if(!planned)
+        _requestedAnalysisSize.store(samples);
+
+    int frameSize = DSPKernels::MAX_BLOCK_SIZE;
+    int spectrumSize = samples / 2 + 1;
+
+    // Let every channel write its analysis frame into the batch.
+    bool analysisPending = false;
+    for(int i = 0; i < _earFilters.count(); i++) {
+        analysisPending |= _earFilters.at(i)->prepareAnalysis(
+            samples, batch->m_frames + i * frameSize);
+    }
+
+    // Transform the frames of all channels in a single run and separate
+    // the measured from the reference spectrum.
+    if(analysisPending && planned) {
+        fftw_execute(batch->m_plan);
+        for(int i = 0; i < _earFilters.count(); i++) {
+            FFTWAdapter::separateSpectra(
+                batch->m_transforms + i * frameSize,
+                batch->m_spectra + (2 * i) * spectrumSize,
+                batch->m_spectra + (2 * i + 1) * spectrumSize,
+                samples);
+        }
+    }
+
+    // Hand the spectra back to the channels.
+    for(int i = 0; i < _earFilters.count(); i++) {
+        _earFilters.at(i)->finishProcessing(
+            samples,
+            planned ? batch->m_spectra + (2 * i) * spectrumSize : 0,
+            planned ? batch->m_spectra + (2 * i + 1) * spectrumSize : 0);
     }
 }
 
@@ -51,17 +109,204 @@ EARFilter *DSPCore::addEARFilter() {
         ref = _client.registerAudioInPort(QString("ref_%1").arg(num)),
         out = _client.registerAudioOutPort(QString("out_%1").arg(num))
     );
+    filter->setSampleRate(_client.sampleRate());
+    filter->setNoiseSeed(_noiseSeed, num - 1);
 
-    SemaphoreLocker locker(_earFiltersSemaphore);
-    _earFilters.append(filter);
+    // Prepare the analysis of one more channel before holding up the
+    // process callback.
+    replaceAnalysisBatch(createAnalysisBatch(num, _requestedAnalysisSize.load()), filter);
 
     _client.connect(_client.portByName(QString("system:capture_%1").arg(num)), in);
     _client.connect(out, _client.portByName(QString("system:playback_%1").arg(num)));
     return filter;
 }
 
+void DSPCore::setNoiseSeed(uint32_t seed) {
+    _noiseSeed = seed;
+}
+
+uint32_t DSPCore::noiseSeed() {
+    return _noiseSeed;
+}
+
+bool DSPCore::savePreset(QString fileName) {
+    QList<EARFilter*> filters = earFilters();
+    QVector<PresetFile::Channel> channels(filters.count());
+    for(int i = 0; i < filters.count(); i++)
+        filters.at(i)->storePreset(&channels[i]);
+    return PresetFile::write(fileName, channels.constData(), channels.count());
+}
+
+bool DSPCore::loadPreset(QString fileName) {
+    PresetFile presetFile;
+    if(!presetFile.open(fileName))
+        return false;
+
+    QList<EARFilter*> filters = earFilters();
+    int channels = qMin(filters.count(), presetFile.channels());
+    bool applied = true;
+    for(int i = 0; i < channels; i++) {
+        if(!filters.at(i)->applyPreset(*presetFile.channel(i))) {
+            qDebug() << "Invalid preset for" << filters.at(i)->name();
+            applied = false;
+        }
+    }
+    return applied;
+}
+
+bool DSPCore::loadPresetIntoBank(QString fileName, int bank) {
+    if(bank < 0 || bank >= Equalizer::BANK_SIZE)
+        return false;
+
+    PresetFile presetFile;
+    if(!presetFile.open(fileName))
+        return false;
+
+    // A channel left out would keep what the bank held before, and the
+    // bank would play a mix of two presets.
+    QList<EARFilter*> filters = earFilters();
+    if(presetFile.channels() < filters.count()) {
+        qDebug() << "Preset has only" << presetFile.channels() << "channels.";
+        return false;
+    }
+
+    // Check everything the builders would refuse before touching any bank,
+    // they can only report failures to the log.
+    int channels = filters.count();
+    for(int i = 0; i < channels; i++) {
+        const PresetFile::Channel *channel = presetFile.channel(i);
+        if(!Equalizer::controlsFitGrid(channel->m_bandsPerOctave, channel->m_sampleRate,
+                                       channel->m_numberOfControls)) {
+            qDebug() << "Invalid preset for" << filters.at(i)->name();
+            return false;
+        }
+        if(filters.at(i)->equalizer()->bankInUse(bank))
+            return false;
+    }
+
+    bool reserved = true;
+    for(int i = 0; i < channels; i++) {
+        const PresetFile::Channel *channel = presetFile.channel(i);
+        if(!filters.at(i)->equalizer()->reserveBank(bank)) {
+            reserved = false;
+            continue;
+        }
+        QThreadPool::globalInstance()->start(
+            new FilterBankBuilder(filters.at(i)->equalizer(), bank,
+                                  channel->m_bandsPerOctave, channel->m_sampleRate,
+                                  channel->m_controls, channel->m_numberOfControls));
+    }
+    return reserved;
+}
+
+bool DSPCore::selectBank(int bank) {
+    // Switch either all channels or none of them.
+    QList<EARFilter*> filters = earFilters();
+    if(bank != Equalizer::LIVE_FILTER) {
+        foreach(EARFilter *filter, filters) {
+            if(!filter->equalizer()->bankReady(bank))
+                return false;
+        }
+    }
+
+    bool selected = true;
+    foreach(EARFilter *filter, filters) {
+        if(!filter->equalizer()->selectBank(bank))
+            selected = false;
+    }
+    return selected;
+}
+
 QList<EARFilter*> DSPCore::earFilters() {
     SemaphoreLocker locker(_earFiltersSemaphore);
     return _earFilters;
 }
 
+
+DSPCore::AnalysisBatch *DSPCore::createAnalysisBatch(int channels, int samples) {
+    AnalysisBatch *analysisBatch = new AnalysisBatch;
+    analysisBatch->m_channels = channels;
+    analysisBatch->m_samples = samples;
+
+    // Reserve room for the largest period, so that the channels always
+    // have a frame to write to.
+    int frameSize = DSPKernels::MAX_BLOCK_SIZE;
+    analysisBatch->m_frames = (fftw_complex*)fftw_malloc(
+        sizeof(fftw_complex) * channels * frameSize);
+    analysisBatch->m_transforms = (fftw_complex*)fftw_malloc(
+        sizeof(fftw_complex) * channels * frameSize);
+    analysisBatch->m_spectra = (fftw_complex*)fftw_malloc(
+        sizeof(fftw_complex) * 2 * channels * (frameSize / 2 + 1));
+
+    for(int i = 0; i < channels * frameSize; i++) {
+        analysisBatch->m_frames[i][0] = 0.0;
+        analysisBatch->m_frames[i][1] = 0.0;
+    }
+
+    // Frames are laid out with a fixed distance of MAX_BLOCK_SIZE samples,
+    // one packed frame per channel.
+    analysisBatch->m_plan = 0;
+    if(channels > 0 && samples > 0 && samples <= DSPKernels::MAX_BLOCK_SIZE) {
+        analysisBatch->m_plan = FFTWAdapter::planBatchedFFT(analysisBatch->m_frames,
+                                                            analysisBatch->m_transforms,
+                                                            frameSize,
+                                                            samples,
+                                                            channels);
+    }
+    return analysisBatch;
+}
+
+void DSPCore::destroyAnalysisBatch(AnalysisBatch *analysisBatch) {
+    if(!analysisBatch)
+        return;
+
+    if(analysisBatch->m_plan) {
+        SemaphoreLocker locker(FFTWAdapter::plannerSemaphore());
+        Q_UNUSED(locker);
+        fftw_destroy_plan(analysisBatch->m_plan);
+    }
+    fftw_free(analysisBatch->m_frames);
+    fftw_free(analysisBatch->m_transforms);
+    fftw_free(analysisBatch->m_spectra);
+    delete analysisBatch;
+}
+
+void DSPCore::replaceAnalysisBatch(AnalysisBatch *analysisBatch, EARFilter *earFilter) {
+    // Only swap pointers while holding up the process callback, and
+    // destroy the old batch afterwards.
+    AnalysisBatch *previousAnalysisBatch;
+    {
+        SemaphoreLocker locker(_earFiltersSemaphore);
+        Q_UNUSED(locker);
+        previousAnalysisBatch = _analysisBatch;
+        _analysisBatch = analysisBatch;
+        if(earFilter)
+            _earFilters.append(earFilter);
+    }
+    destroyAnalysisBatch(previousAnalysisBatch);
+}
+
+void DSPCore::timerEvent(QTimerEvent *timerEvent) {
+    Q_UNUSED(timerEvent);
+
+    // Only this thread replaces the batch, so it may be read unlocked.
+    int samples = _requestedAnalysisSize.load();
+    if(!_analysisBatch || _analysisBatch->m_samples == samples)
+        return;
+
+    replaceAnalysisBatch(createAnalysisBatch(_analysisBatch->m_channels, samples), 0);
+}
+
+bool DSPCore::startParallelCalibration() {
+    if(_parallelCalibration && _parallelCalibration->isRunning())
+        return false;
+
+    delete _parallelCalibration;
+    _parallelCalibration = new ParallelCalibration(earFilters());
+    if(!_parallelCalibration->startChannels())
+        return false;
+
+    connect(_parallelCalibration, SIGNAL(finished()), this, SIGNAL(parallelCalibrationFinished()));
+    _parallelCalibration->start();
+    return true;
+}
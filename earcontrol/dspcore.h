@@ -24,11 +24,15 @@
 #include <Processor>
 #include <QList>
 #include <QSemaphore>
+#include <QAtomicInt>
+#include <QTimerEvent>
 
 #include "equalizer.h"
 #include "jnoise/jnoise.h"
 
 #include "earfilter.h"
+#include "parallelcalibration.h"
+#include "presetfile.h"
 #include "semaphorelocker.h"
 
 class DSPCore :
@@ -37,20 +41,141 @@ class DSPCore :
     Q_OBJECT
 public:
     DSPCore(QtJack::Client& client);
+    ~DSPCore();
+
     QtJack::Client& client();
 
     void process(int samples);
 
     EARFilter *addEARFilter();
 
+    /**
+      * Sets the seed of the noise signal sources of channels added later on.
+      * Every channel plays noise of its own, independent of the others.
+      * @param seed Seed, zero seeds from the current time.
+      */
+    void setNoiseSeed(uint32_t seed);
+
+    /** @return Seed of the noise signal sources. */
+    uint32_t noiseSeed();
+
     QList<EARFilter*> earFilters();
 
+    /**
+      * Calibrates the latency of all channels at once.
+      * @return false, if a calibration is running already or a channel is
+      *         busy measuring.
+      */
+    bool startParallelCalibration();
+
+    /**
+      * Saves the state of all channels into a binary preset.
+      * @param fileName File name of the preset.
+      * @return true on success, otherwise false.
+      */
+    bool savePreset(QString fileName);
+
+    /**
+      * Restores the state of the channels from a binary preset. Channels
+      * beyond those in the preset are left alone.
+      * @param fileName File name of the preset.
+      * @return true on success, otherwise false.
+      */
+    bool loadPreset(QString fileName);
+
+    /**
+      * Builds the filters of a preset into a bank of the equalizers, one
+      * channel after another, in the background. The channels keep their
+      * current state otherwise. The bank stays empty until the filters
+      * have been built.
+      * @param fileName File name of the preset.
+      * @param bank Index of the filter in the bank.
+      * @return false, if the preset is invalid, has fewer channels than
+      *         there are filters, or the bank is selected or playing on
+      *         any channel.
+      */
+    bool loadPresetIntoBank(QString fileName, int bank);
+
+    /**
+      * Switches all channels to a filter of their bank.
+      * @param bank Index of the filter in the bank, or Equalizer::LIVE_FILTER.
+      * @return false, if a channel has no such filter yet.
+      */
+    bool selectBank(int bank);
+
+signals:
+    /** Emitted when the parallel calibration has analyzed all channels. */
+    void parallelCalibrationFinished();
+
+protected:
+    /** Plans the analysis anew, once the period size has changed. */
+    void timerEvent(QTimerEvent *timerEvent);
+
 private:
+    /** Default seed of the noise, so measurements are reproducible. */
+    static const uint32_t DEFAULT_NOISE_SEED = 0x4e4f4953;
+
+    /** Interval in milliseconds to check for a new period size. */
+    static const int PLANNING_INTERVAL = 100;
+
+    /** Buffers and plan of the batched analysis of all channels. */
+    struct AnalysisBatch {
+        /** Number of channels. */
+        int m_channels;
+
+        /** Period size the analysis has been planned for. */
+        int m_samples;
+
+        /** Packed analysis frames of all channels, one after another. */
+        fftw_complex *m_frames;
+
+        /** Transforms of the packed analysis frames. */
+        fftw_complex *m_transforms;
+
+        /** Measured and reference spectra of all channels, separated. */
+        fftw_complex *m_spectra;
+
+        /** Plan transforming all analysis frames at once, or null. */
+        fftw_plan m_plan;
+    };
+
+    /**
+      * Allocates and plans the analysis of the given number of channels.
+      * Runs the FFTW planner, so it must not be called from the process
+      * callback.
+      * @param channels Number of channels.
+      * @param samples Period size to plan for.
+      * @return The analysis batch.
+      */
+    AnalysisBatch *createAnalysisBatch(int channels, int samples);
+
+    /** Destroys an analysis batch that is not in use anymore. */
+    void destroyAnalysisBatch(AnalysisBatch *analysisBatch);
+
+    /**
+      * Puts a new analysis batch in place of the one in use.
+      * @param analysisBatch The new analysis batch.
+      * @param earFilter Filter to add along with it, or null.
+      */
+    void replaceAnalysisBatch(AnalysisBatch *analysisBatch, EARFilter *earFilter);
+
     QtJack::Client& _client;
 
     QList<EARFilter*> _earFilters;
 
     QSemaphore *_earFiltersSemaphore;
+
+    /** Seed of the noise signal sources. */
+    uint32_t _noiseSeed;
+
+    /** Analysis of all channels, replaced under the filters semaphore. */
+    AnalysisBatch *_analysisBatch;
+
+    /** Period size the process callback asks the analysis to be planned for. */
+    QAtomicInt _requestedAnalysisSize;
+
+    /** Last parallel calibration, kept until the next one. */
+    ParallelCalibration *_parallelCalibration;
 };
 
 #endif // DSPCORE_H
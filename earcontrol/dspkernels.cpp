@@ -0,0 +1,53 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dspkernels.h"
+
+#define KERNEL_TABLE(N) {                                   \
+    N,                                                      \
+    &DSPKernels::windowToRealPart<N>,                       \
+    &DSPKernels::copy<N>,                                   \
+    &DSPKernels::silence<N>,                                \
+    &DSPKernels::peak<N>,                                   \
+    &DSPKernels::convolve<N, DSPKernels::FILTER_TAPS>       \
+}
+
+static const DSPKernels::KernelTable genericKernels = KERNEL_TABLE(0);
+
+// Specialized kernels for the periods JACK is usually run with.
+static const DSPKernels::KernelTable specializedKernels[] = {
+    KERNEL_TABLE(32),
+    KERNEL_TABLE(64),
+    KERNEL_TABLE(128),
+    KERNEL_TABLE(256),
+    KERNEL_TABLE(512),
+    KERNEL_TABLE(1024),
+    KERNEL_TABLE(2048),
+    KERNEL_TABLE(4096)
+};
+
+const DSPKernels::KernelTable *DSPKernels::kernelTable(int blockSize) {
+    int count = sizeof(specializedKernels) / sizeof(specializedKernels[0]);
+    for(int i = 0; i < count; i++) {
+        if(specializedKernels[i].blockSize == blockSize)
+            return &specializedKernels[i];
+    }
+    return &genericKernels;
+}
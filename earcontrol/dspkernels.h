@@ -0,0 +1,148 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DSPKERNELS_H
+#define DSPKERNELS_H
+
+// JACK includes:
+#include <jack/jack.h>
+
+// FFTW3 includes:
+#include "fftw3.h"
+
+/**
+  * Hot loops of the audio path, written as templates over the block size
+  * and the number of filter taps. For the common power-of-two JACK periods
+  * the trip counts are compile time constants, so the compiler is able to
+  * fully unroll and vectorize them. Instantiating a kernel with a block size
+  * of zero yields the generic version that takes the trip count at runtime.
+  *
+  * Do not call the kernels directly, pick a kernel table with kernelTable()
+  * whenever the buffer size changes and call through it.
+  */
+namespace DSPKernels {
+  /** Largest JACK period the kernels are specialized for. */
+  static const int MAX_BLOCK_SIZE = 4096;
+
+  /** Number of filter taps the convolution kernel is specialized for. */
+  static const int FILTER_TAPS = 201;
+
+  template<int N>
+  void windowToRealPart(const jack_default_audio_sample_t *in, const double *window,
+                        fftw_complex *out, int n) {
+      const int count = N ? N : n;
+      for(int i = 0; i < count; i++) {
+          out[i][0] = in[i] * window[i];
+      }
+  }
+
+  template<int N>
+  void copy(const jack_default_audio_sample_t *in, jack_default_audio_sample_t *out, int n) {
+      const int count = N ? N : n;
+      for(int i = 0; i < count; i++) {
+          out[i] = in[i];
+      }
+  }
+
+  template<int N>
+  void silence(jack_default_audio_sample_t *out, int n) {
+      const int count = N ? N : n;
+      for(int i = 0; i < count; i++) {
+          out[i] = 0.0f;
+      }
+  }
+
+  template<int N>
+  double peak(const jack_default_audio_sample_t *in, int n) {
+      const int count = N ? N : n;
+      jack_default_audio_sample_t result = 0.0f;
+      for(int i = 0; i < count; i++) {
+          jack_default_audio_sample_t value = in[i] < 0.0f ? -in[i] : in[i];
+          result = value > result ? value : result;
+      }
+      return result;
+  }
+
+  /**
+    * FIR convolution of one block. The history must hold the last
+    * TAPS - 1 input samples of the previous block at its beginning and
+    * provide room for another MAX_BLOCK_SIZE samples after them.
+    * @param coefficients TAPS filter coefficients.
+    * @param history Convolution history, updated in place.
+    * @param in Input samples.
+    * @param out Output samples, must not alias the input.
+    * @param n Number of samples, only used by the generic kernel.
+    */
+  template<int N, int TAPS>
+  void convolve(const double *coefficients, double *history,
+                const jack_default_audio_sample_t *in,
+                jack_default_audio_sample_t *out, int n) {
+      const int count = N ? N : n;
+      double *block = history + TAPS - 1;
+      double accumulator[N ? N : MAX_BLOCK_SIZE];
+
+      for(int i = 0; i < count; i++) {
+          block[i] = in[i];
+          accumulator[i] = 0.0;
+      }
+
+      // Iterate over the taps in the outer loop, so that the inner loop runs
+      // over consecutive samples and can be vectorized.
+      for(int j = 0; j < TAPS; j++) {
+          const double coefficient = coefficients[j];
+          const double *delayed = block - j;
+          for(int i = 0; i < count; i++)
+              accumulator[i] += coefficient * delayed[i];
+      }
+
+      for(int i = 0; i < count; i++) {
+          out[i] = accumulator[i];
+      }
+
+      // Keep the most recent samples for the next block.
+      for(int i = 0; i < TAPS - 1; i++)
+          history[i] = history[count + i];
+  }
+
+  /** Function table with all kernels for one block size. */
+  struct KernelTable {
+      /** Block size the kernels are specialized for, zero if generic. */
+      int blockSize;
+
+      void (*windowToRealPart)(const jack_default_audio_sample_t *in, const double *window,
+                               fftw_complex *out, int n);
+      void (*copy)(const jack_default_audio_sample_t *in, jack_default_audio_sample_t *out, int n);
+      void (*silence)(jack_default_audio_sample_t *out, int n);
+      double (*peak)(const jack_default_audio_sample_t *in, int n);
+      void (*convolve)(const double *coefficients, double *history,
+                       const jack_default_audio_sample_t *in,
+                       jack_default_audio_sample_t *out, int n);
+  };
+
+  /**
+    * Looks up the kernels for the given block size. Falls back to the
+    * generic kernels if there is no specialization for this size.
+    * @param blockSize Number of samples per period.
+    * @return Kernel table, never null.
+    */
+  const KernelTable *kernelTable(int blockSize);
+}
+
+#endif // DSPKERNELS_H
@@ -33,6 +33,8 @@ EARChannelWidget::EARChannelWidget(EARFilter *earFilter, QWidget *parent) :
 
     QVBoxLayout *layout = new QVBoxLayout();
     layout->addWidget(_equalizerWidget = new EqualizerWidget(earFilter->equalizer(), 20, 22050));
+    layout->addWidget(_spectrumAnalyzerWidget = new SpectrumAnalyzerWidget(earFilter->analyzerFeed(), earFilter->equalizer()));
+    _spectrumAnalyzerWidget->hide();
     ui->frame->setLayout(layout);
 
     setStyleSheet(
@@ -54,18 +56,39 @@ EARChannelWidget::EARChannelWidget(EARFilter *earFilter, QWidget *parent) :
     connect(_earFilter, SIGNAL(referenceSignalLevelChanged(int)), ui->progressBarRef, SLOT(setValue(int)));
     connect(_earFilter, SIGNAL(outputSignalLevelChanged(int)), ui->progressBarOut, SLOT(setValue(int)));
 
+    connect(_earFilter, SIGNAL(calibrationStarted()), this, SLOT(calibrationStarted()));
     connect(_earFilter, SIGNAL(calibrationFinished()), this, SLOT(calibrationFinished()));
+    connect(_earFilter, SIGNAL(impulseResponseMeasured()), this, SLOT(impulseResponseMeasured()));
+    connect(_earFilter, SIGNAL(adaptionStateChanged()), this, SLOT(adaptionStateChanged()));
 
     ui->pushButtonAutomaticAdaption->setChecked(_earFilter->automaticAdaptionActive());
     ui->pushButtonBypass->setChecked(_earFilter->bypassActive());
+    ui->pushButtonTrackLatency->setChecked(_earFilter->latencyTrackingActive());
 }
 
 EARChannelWidget::~EARChannelWidget() {
     delete ui;
 }
 
+void EARChannelWidget::updateFromFilter() {
+    // The items of the combo boxes follow the order of the enums.
+    ui->comboBoxSignalSource->setCurrentIndex(_earFilter->signalSource());
+    ui->comboBoxAdaptionEngine->setCurrentIndex(_earFilter->adaptionEngine());
+    ui->comboBoxCalibrationMethod->setCurrentText(
+        _earFilter->calibrationMethod() == EARFilter::MLSCalibration ?
+            "MLS calibration" : "Click calibration");
+    ui->comboBoxControlGrid->setCurrentText(
+        QString("1/%1 octave").arg(_earFilter->equalizer()->bandsPerOctave()));
+
+    ui->pushButtonAutomaticAdaption->setChecked(_earFilter->automaticAdaptionActive());
+    ui->pushButtonBypass->setChecked(_earFilter->bypassActive());
+    ui->pushButtonTrackLatency->setChecked(_earFilter->latencyTrackingActive());
+    adaptionStateChanged();
+}
+
 void EARChannelWidget::on_pushButtonAutomaticAdaption_clicked(bool on) {
     _earFilter->setAutomaticAdaptionActive(on);
+    adaptionStateChanged();
 }
 
 void EARChannelWidget::on_comboBoxSignalSource_currentTextChanged(QString text) {
@@ -75,21 +98,112 @@ void EARChannelWidget::on_comboBoxSignalSource_currentTextChanged(QString text)
         _earFilter->setSignalSource(EARFilter::WhiteNoise);
     if(text == "Pink noise")
         _earFilter->setSignalSource(EARFilter::PinkNoise);
+    if(text == "Periodic white noise")
+        _earFilter->setSignalSource(EARFilter::PeriodicWhiteNoise);
+    if(text == "Periodic pink noise")
+        _earFilter->setSignalSource(EARFilter::PeriodicPinkNoise);
+}
+
+void EARChannelWidget::on_comboBoxCalibrationMethod_currentTextChanged(QString text) {
+    if(text == "MLS calibration")
+        _earFilter->setCalibrationMethod(EARFilter::MLSCalibration);
+    if(text == "Click calibration")
+        _earFilter->setCalibrationMethod(EARFilter::ClickCalibration);
+}
+
+void EARChannelWidget::on_comboBoxAdaptionEngine_currentTextChanged(QString text) {
+    if(text == "Coherence weighted")
+        _earFilter->setAdaptionEngine(EARFilter::CoherenceWeightedAdaption);
+    if(text == "Block NLMS")
+        _earFilter->setAdaptionEngine(EARFilter::BlockNLMSAdaption);
+}
+
+void EARChannelWidget::on_comboBoxControlGrid_currentTextChanged(QString text) {
+    if(text == "1/3 octave")
+        _earFilter->equalizer()->setBandsPerOctave(3);
+    if(text == "1/6 octave")
+        _earFilter->equalizer()->setBandsPerOctave(6);
+    if(text == "1/12 octave")
+        _earFilter->equalizer()->setBandsPerOctave(12);
+    if(text == "1/24 octave")
+        _earFilter->equalizer()->setBandsPerOctave(24);
+}
+
+void EARChannelWidget::calibrationStarted() {
+    // Restarting would rewrite the calibration while it is recorded.
+    ui->pushButtonCalibrate->setChecked(true);
+    ui->pushButtonCalibrate->setEnabled(false);
 }
 
 void EARChannelWidget::calibrationFinished() {
     ui->pushButtonCalibrate->setChecked(false);
+    ui->pushButtonCalibrate->setEnabled(true);
+    if(_earFilter->calibrationMethod() == EARFilter::MLSCalibration) {
+        ui->pushButtonCalibrate->setToolTip(
+            QString("Latency: %1 samples, SNR: %2 dB")
+                .arg(_earFilter->preciseLatency(), 0, 'f', 2)
+                .arg(_earFilter->calibrationSignalToNoiseRatio(), 0, 'f', 1));
+    }
 }
 
 void EARChannelWidget::on_pushButtonCalibrate_clicked() {
-    ui->pushButtonCalibrate->setChecked(true);
-    _earFilter->startCalibration();
+    // Refused while the channel is measuring.
+    if(!_earFilter->startCalibration())
+        ui->pushButtonCalibrate->setChecked(false);
+}
+
+void EARChannelWidget::impulseResponseMeasured() {
+    ui->pushButtonMeasure->setChecked(false);
+    ui->pushButtonMeasure->setEnabled(true);
+}
+
+void EARChannelWidget::adaptionStateChanged() {
+    if(!_earFilter->automaticAdaptionActive()) {
+        ui->labelAdaptionState->clear();
+        ui->labelAdaptionState->setToolTip(QString());
+        return;
+    }
+
+    bool frozen = _earFilter->adaptionState() == EARFilter::AdaptionFrozen;
+    ui->labelAdaptionState->setText(frozen ? "Converged" : "Adapting");
+    ui->labelAdaptionState->setToolTip(
+        QString("Control delta: %1 dB, spectral error: %2 dB, coherence: %3")
+            .arg(_earFilter->adaptionControlDelta(), 0, 'f', 2)
+            .arg(_earFilter->adaptionSpectralError(), 0, 'f', 1)
+            .arg(_earFilter->adaptionCoherence(), 0, 'f', 2));
+
+    qDebug() << _earFilter->name()
+             << (frozen ? "adaption converged, freezing controls" : "adaption running")
+             << "- spectral error" << _earFilter->adaptionSpectralError() << "dB";
+}
+
+void EARChannelWidget::on_pushButtonMeasure_clicked() {
+    // Restarting would reset the measurement while it is recorded.
+    if(!_earFilter->startMeasurement()) {
+        ui->pushButtonMeasure->setChecked(false);
+        return;
+    }
+    ui->pushButtonMeasure->setChecked(true);
+    ui->pushButtonMeasure->setEnabled(false);
 }
 
 void EARChannelWidget::on_pushButtonBypass_clicked(bool on) {
     _earFilter->setBypassActive(on);
 }
 
+void EARChannelWidget::on_pushButtonTrackLatency_clicked(bool on) {
+    _earFilter->setLatencyTrackingActive(on);
+}
+
+void EARChannelWidget::on_pushButtonAnalyzer_clicked(bool on) {
+    _spectrumAnalyzerWidget->setVisible(on);
+    ui->pushButtonSpectrogram->setEnabled(on);
+}
+
+void EARChannelWidget::on_pushButtonSpectrogram_clicked(bool on) {
+    _spectrumAnalyzerWidget->setSpectrogramVisible(on);
+}
+
 
 
 
@@ -6,6 +6,7 @@
 
 #include "earfilter.h"
 #include "equalizerwidget.h"
+#include "spectrumanalyzerwidget.h"
 
 namespace Ui {
 class EARChannelWidget;
@@ -19,15 +20,29 @@ public:
     explicit EARChannelWidget(EARFilter *earFilter, QWidget *parent = 0);
     ~EARChannelWidget();
 
+    /** Shows the current switches of the filter, after they have been
+      * changed elsewhere. */
+    void updateFromFilter();
+
 public slots:
     void on_pushButtonAutomaticAdaption_clicked(bool on);
     void on_pushButtonCalibrate_clicked();
+    void on_pushButtonMeasure_clicked();
     void on_pushButtonBypass_clicked(bool on);
+    void on_pushButtonTrackLatency_clicked(bool on);
+    void on_pushButtonAnalyzer_clicked(bool on);
+    void on_pushButtonSpectrogram_clicked(bool on);
 
     void on_comboBoxSignalSource_currentTextChanged(QString text);
+    void on_comboBoxCalibrationMethod_currentTextChanged(QString text);
+    void on_comboBoxAdaptionEngine_currentTextChanged(QString text);
+    void on_comboBoxControlGrid_currentTextChanged(QString text);
 
 private slots:
+    void calibrationStarted();
     void calibrationFinished();
+    void impulseResponseMeasured();
+    void adaptionStateChanged();
 
 private:
     Ui::EARChannelWidget *ui;
@@ -35,6 +50,7 @@ private:
     QTimer *_updateGUITimer;
 
     EqualizerWidget *_equalizerWidget;
+    SpectrumAnalyzerWidget *_spectrumAnalyzerWidget;
 
     EARFilter *_earFilter;
 };
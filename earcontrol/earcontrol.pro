@@ -23,29 +23,63 @@ LIBS += -lfftw3
 
 SOURCES += \
     fftwadapter.cpp \
+    dspkernels.cpp \
+    channelarena.cpp \
+    latencytracker.cpp \
+    noisefeeder.cpp \
+    analyzerfeed.cpp \
+    presetfile.cpp \
+    filterbankbuilder.cpp \
+    mlsanalyzer.cpp \
+    sweepmeasurement.cpp \
+    parallelcalibration.cpp \
+    spectralestimator.cpp \
+    blocknlms.cpp \
+    controlgrid.cpp \
+    spectralsmoother.cpp \
+    periodicnoise.cpp \
     launcher.cpp \
     mainwindow.cpp \
     jnoise/jnoise.cpp \
     jnoise/randomgenerator.cpp \
+    jnoise/blockrandomgenerator.cpp \
     dspcore.cpp \
     earfilter.cpp \
     earchannelwidget.cpp \
     equalizerwidget.cpp \
+    spectrumanalyzerwidget.cpp \
     equalizer.cpp
 
 HEADERS += \
     fftwadapter.h \
+    dspkernels.h \
+    channelarena.h \
+    latencytracker.h \
+    noisefeeder.h \
+    analyzerfeed.h \
+    presetfile.h \
+    filterbankbuilder.h \
+    mlsanalyzer.h \
+    sweepmeasurement.h \
+    parallelcalibration.h \
+    spectralestimator.h \
+    blocknlms.h \
+    controlgrid.h \
+    spectralsmoother.h \
+    periodicnoise.h \
     launcher.cpp \
     mainwindow.h \
     Splash.png \
     jnoise/jnoise.h \
     jnoise/prbsgenerator.h \
     jnoise/randomgenerator.h \
+    jnoise/blockrandomgenerator.h \
     dspcore.h \
     semaphorelocker.h \
     earfilter.h \
     earchannelwidget.h \
     equalizerwidget.h \
+    spectrumanalyzerwidget.h \
     equalizer.h
 
 FORMS += \
@@ -22,43 +22,192 @@
 
 #include "earfilter.h"
 
-#include "semaphorelocker.h"
-
 #include <cmath>
+#include <new>
+
+const float EARFilter::MLS_AMPLITUDE = 0.5f;
+const double EARFilter::MLS_MINIMUM_SNR = 10.0;
+const double EARFilter::SWEEP_DURATION = 3.0;
+const double EARFilter::ADAPTION_RATE = 0.25;
+const double EARFilter::ADAPTION_SMOOTHING = 3.0;
+const double EARFilter::MINIMUM_COHERENCE = 0.5;
+const double EARFilter::NLMS_TRANSFER_SHARE = 0.5;
+const double EARFilter::CONVERGED_CONTROL_DELTA = 0.05;
+const double EARFilter::CONVERGED_SPECTRAL_ERROR = 1.5;
+const double EARFilter::CONVERGENCE_TIME = 2.0;
+const double EARFilter::RESUME_SPECTRAL_ERROR = 3.0;
 
 EARFilter::EARFilter(
     QString name,
     QtJack::AudioPort in,
     QtJack::AudioPort ref,
     QtJack::AudioPort out) :
-    QtJack::Processor(),
+    QObject(),
     _name(name),
-    _in(in), _ref(ref), _out(out) {
+    _in(in), _ref(ref), _out(out),
+    _adaptionSmoother(ControlGrid::MAX_BANDS) {
 
-    _adaptionActive = false;
-    _operationMode = ProcessingAudio;
-    m_signalSource = ExternalSource;
+    _adaptionActive.store(false);
+    setOperationMode(ProcessingAudio);
+    m_signalSource.store(ExternalSource);
 
 
-    _bypassActive = true;
+    _bypassActive.store(true);
+    _latencyTrackingActive.store(false);
 
-    while(_latencyBuffer.size() < 44100)
-        _latencyBuffer.append(0.0);
+    for(int i = 0; i < LATENCY_BUFFER_SIZE; i++)
+        _latencyBuffer[i] = 0.0f;
+    _latencyBufferPosition = 0;
 
+    _calibration.m_waitingForClick = false;
     _calibration.m_latency = 12000;
+    _calibration.m_offset = 0;
+    _calibration.m_numberOfMeasures = 0;
+    _calibration.m_position = 0;
+    _calibration.m_preciseLatency = _calibration.m_latency;
+    _calibration.m_signalToNoiseRatio = 0.0;
+    _calibration.m_sequence = 0;
+    _calibration.m_workspace = 0;
+    _calibration.m_shift = 0;
+    _calibration.m_searchLength = LATENCY_BUFFER_SIZE;
+    _calibrationRecorded.store(false);
+    _calibrationTimer = 0;
+    _requestedLatency.store(-1);
+
+    _calibrationMethod.store(MLSCalibration);
+    _mlsAnalyzer = 0;
+    _mlsWorkspace = 0;
+
+    _sweepMeasurement = 0;
+    _sampleRate = 44100;
+
+    _blockSize = 0;
+    _rectangularWindow = false;
+    _kernels = DSPKernels::kernelTable(_blockSize);
+    _analysisPending = false;
+    _estimatorLatency = _calibration.m_latency;
+    _adaptionEngine.store(CoherenceWeightedAdaption);
+    _activeEngine = CoherenceWeightedAdaption;
+    _smoothedBandsPerOctave = 0;
+    _adaptionState.store(AdaptionRunning);
+
+    _convergence.m_controlDelta = 0.0;
+    _convergence.m_spectralError = 0.0;
+    _convergence.m_coherence = 0.0;
+    _convergence.m_stableSamples = 0;
+    _convergence.m_skippedPeriods = 0;
+
+    _latencyTracker = new LatencyTracker(LATENCY_BUFFER_SIZE - DSPKernels::MAX_BLOCK_SIZE);
+    _noiseFeeder = new NoiseFeeder();
+}
+
+EARFilter::~EARFilter() {
+    delete _latencyTracker;
+    delete _noiseFeeder;
+    delete _mlsAnalyzer;
+    delete[] _mlsWorkspace;
+    delete _sweepMeasurement;
+}
+
+void *EARFilter::operator new(size_t size) {
+    void *memory = ChannelArena::allocate(size);
+    if(!memory)
+        throw std::bad_alloc();
+    return memory;
+}
 
-    m_signalSourceSemaphore = new QSemaphore(1);
-    m_automaticAdaptionSemaphore = new QSemaphore(1);
-    m_bypassSemaphore = new QSemaphore(1);
+void EARFilter::operator delete(void *memory, size_t size) {
+    ChannelArena::release(memory, size);
 }
 
-void EARFilter::process(int samples) {
-    switch(_operationMode) {
+bool EARFilter::prepareAnalysis(int samples, fftw_complex *frame) {
+    // Pick the specialized kernels only when the period size has changed.
+    bool blockSizeChanged = samples != _blockSize;
+    if(blockSizeChanged) {
+        _blockSize = samples;
+        _kernels = DSPKernels::kernelTable(samples);
+    }
+
+    // Periodic noise needs no window, as long as its period matches the
+    // frame. Everything else is windowed to reduce the leakage.
+    SignalSource source = signalSource();
+    bool rectangularWindow = (source == PeriodicWhiteNoise || source == PeriodicPinkNoise)
+                           && _periodicNoise.table(PeriodicNoise::White, samples);
+    if(blockSizeChanged || rectangularWindow != _rectangularWindow) {
+        _rectangularWindow = rectangularWindow;
+        for(int i = 0; i < samples; i++) {
+            _analysisWindow[i] = rectangularWindow ? 1.0
+                               : 0.5 - 0.5 * cos(2.0 * M_PI * i / samples);
+        }
+    }
+
+    fetchPortBuffers(samples);
+    _analysisPending = false;
+
+    // A preset has been loaded.
+    int requestedLatency = _requestedLatency.fetchAndStoreOrdered(-1);
+    if(requestedLatency >= 0) {
+        _calibration.m_latency = requestedLatency;
+        _calibration.m_preciseLatency = requestedLatency;
+        _latencyTracker->reset();
+    }
+
+    if(operationMode() != ProcessingAudio)
+        return false;
+
+    trackLatency(samples);
+
+    // Shift samples of the reference signals into the latency buffer,
+    // overwriting samples that are older than LATENCY_BUFFER_SIZE samples.
+    for(int i = 0; i < samples; i++) {
+        _latencyBuffer[_latencyBufferPosition] = _referenceSignal[i];
+        if(++_latencyBufferPosition == LATENCY_BUFFER_SIZE)
+            _latencyBufferPosition = 0;
+    }
+
+    // The analyzer view needs the spectra even without automatic adaption.
+    bool analyzerActive = _analyzerFeed.active();
+    if(automaticAdaptionActive() || analyzerActive) {
+        // Once the controls have converged, a spectrum now and then is
+        // enough to notice changes of the room, unless the analyzer view
+        // is watching.
+        if(adaptionState() == AdaptionFrozen && !analyzerActive) {
+            if(++_convergence.m_skippedPeriods < MONITOR_DECIMATION)
+                return false;
+            _convergence.m_skippedPeriods = 0;
+        }
+
+        // We can only compare if the latency buffer reaches back far enough.
+        if(latency() + samples <= LATENCY_BUFFER_SIZE) {
+            // Extract delayed samples ready for a comparison. The oldest
+            // sample in the buffer is at the current write position.
+            int position = _latencyBufferPosition
+                         + LATENCY_BUFFER_SIZE - latency() - samples;
+            for(int i = 0; i < samples; i++) {
+                frame[i][1] = _latencyBuffer[(position + i) % LATENCY_BUFFER_SIZE]
+                            * _analysisWindow[i];
+            }
+
+            _kernels->windowToRealPart(_measuredSignal, _analysisWindow, frame, samples);
+            _analysisPending = true;
+        }
+    }
+
+    return _analysisPending;
+}
+
+void EARFilter::finishProcessing(int samples,
+                                 const fftw_complex *measuredSpectrum,
+                                 const fftw_complex *referenceSpectrum) {
+    switch(operationMode()) {
     case CalibratingLatency:
         processCalibration(samples);
         break;
+    case MeasuringImpulseResponse:
+        processMeasurement(samples);
+        break;
     case ProcessingAudio:
-        processRectification(samples);
+        processRectification(samples, measuredSpectrum, referenceSpectrum);
         break;
     };
 }
@@ -67,107 +216,360 @@ Equalizer *EARFilter::equalizer() {
     return &_digitalEqualizer;
 }
 
+void EARFilter::storePreset(PresetFile::Channel *channel) {
+    // The snapshot holds the controls along with the filter designed from
+    // them, without blocking the process callback.
+    Equalizer::ControlsSnapshot snapshot;
+    _digitalEqualizer.readSnapshot(&snapshot);
+
+    channel->m_bandsPerOctave = snapshot.m_bandsPerOctave;
+    channel->m_sampleRate = snapshot.m_sampleRate;
+    channel->m_numberOfControls = snapshot.m_numberOfControls;
+    channel->m_latency = latency();
+    channel->m_signalSource = signalSource();
+    channel->m_adaptionEngine = adaptionEngine();
+    channel->m_calibrationMethod = calibrationMethod();
+    channel->m_flags = (automaticAdaptionActive() ? PresetFile::AutomaticAdaptionActive : 0)
+                     | (bypassActive() ? PresetFile::BypassActive : 0)
+                     | (latencyTrackingActive() ? PresetFile::LatencyTrackingActive : 0);
+
+    // Unused controls are zeroed, so equal states yield equal files.
+    for(int i = 0; i < ControlGrid::MAX_BANDS; i++)
+        channel->m_controls[i] = i < snapshot.m_numberOfControls ? snapshot.m_controls[i] : 0.0;
+    for(int i = 0; i < DSPKernels::FILTER_TAPS; i++)
+        channel->m_coefficients[i] = snapshot.m_coefficients[i];
+}
+
+bool EARFilter::applyPreset(const PresetFile::Channel &channel) {
+    if(channel.m_signalSource < ExternalSource || channel.m_signalSource > PeriodicPinkNoise
+    || channel.m_adaptionEngine < CoherenceWeightedAdaption || channel.m_adaptionEngine > BlockNLMSAdaption
+    || channel.m_calibrationMethod < ClickCalibration || channel.m_calibrationMethod > MLSCalibration
+    || channel.m_latency < 0 || channel.m_latency > LATENCY_BUFFER_SIZE)
+        return false;
+
+    if(!_digitalEqualizer.loadPreset(channel.m_bandsPerOctave, channel.m_sampleRate,
+                                     channel.m_controls, channel.m_numberOfControls,
+                                     channel.m_coefficients))
+        return false;
+
+    _requestedLatency.store(channel.m_latency);
+    setSignalSource((SignalSource)channel.m_signalSource);
+    setAdaptionEngine((AdaptionEngine)channel.m_adaptionEngine);
+    setCalibrationMethod((CalibrationMethod)channel.m_calibrationMethod);
+    setAutomaticAdaptionActive(channel.m_flags & PresetFile::AutomaticAdaptionActive);
+    setBypassActive(channel.m_flags & PresetFile::BypassActive);
+    setLatencyTrackingActive(channel.m_flags & PresetFile::LatencyTrackingActive);
+    return true;
+}
+
+AnalyzerFeed *EARFilter::analyzerFeed() {
+    return &_analyzerFeed;
+}
+
 QString EARFilter::name() {
     return _name;
 }
 
 void EARFilter::setSignalSource(SignalSource signalSource) {
-    SemaphoreLocker locker(m_signalSourceSemaphore);
-    m_signalSource = signalSource;
+    if((signalSource == WhiteNoise || signalSource == PinkNoise)
+       && !_noiseFeeder->isRunning())
+        _noiseFeeder->start(QThread::LowPriority);
+    m_signalSource.store(signalSource);
 }
 
 EARFilter::SignalSource EARFilter::signalSource() {
-    SemaphoreLocker locker(m_signalSourceSemaphore);
-    return m_signalSource;
+    return (SignalSource)m_signalSource.load();
 }
 
 bool EARFilter::automaticAdaptionActive() {
-    SemaphoreLocker locker(m_automaticAdaptionSemaphore);
-    return _adaptionActive;
+    return _adaptionActive.load();
 }
 
 bool EARFilter::bypassActive() {
-    SemaphoreLocker locker(m_bypassSemaphore);
-    return _bypassActive;
+    return _bypassActive.load();
+}
+
+bool EARFilter::latencyTrackingActive() {
+    return _latencyTrackingActive.load();
+}
+
+void EARFilter::setAdaptionEngine(AdaptionEngine adaptionEngine) {
+    _adaptionEngine.store(adaptionEngine);
+}
+
+EARFilter::AdaptionEngine EARFilter::adaptionEngine() {
+    return (AdaptionEngine)_adaptionEngine.load();
+}
+
+EARFilter::AdaptionState EARFilter::adaptionState() {
+    return (AdaptionState)_adaptionState.load();
+}
+
+void EARFilter::setCalibrationMethod(CalibrationMethod calibrationMethod) {
+    _calibrationMethod.store(calibrationMethod);
 }
 
-void EARFilter::startCalibration() {
-    _operationMode = CalibratingLatency;
+EARFilter::CalibrationMethod EARFilter::calibrationMethod() {
+    return (CalibrationMethod)_calibrationMethod.load();
+}
+
+bool EARFilter::startCalibration() {
+    // The process callback reads the calibration state in every other
+    // mode, so it may only be rewritten while processing audio. Only the
+    // GUI thread leaves that mode, so the check cannot race.
+    if(operationMode() != ProcessingAudio)
+        return false;
+
+    bool mls = calibrationMethod() == MLSCalibration;
+
+    // Building the sequence allocates, so do it here instead of the
+    // audio thread. The analyzer is kept for later calibrations.
+    if(mls && !_mlsAnalyzer) {
+        _mlsAnalyzer = new MLSAnalyzer(MLS_ORDER);
+        _mlsWorkspace = new float[_mlsAnalyzer->workspaceSize()];
+    }
+    if(mls)
+        _mlsAnalyzer->reset(_mlsWorkspace);
+
+    _latencyTracker->reset();
     _calibration.m_waitingForClick = false;
-    _calibration.m_latencyMeasures.clear();
-    _calibration.m_weightedMeasures.clear();
+    _calibration.m_numberOfMeasures = 0;
+    _calibration.m_position = 0;
+    _calibration.m_sequence = mls ? _mlsAnalyzer : 0;
+    _calibration.m_workspace = mls ? _mlsWorkspace : 0;
+    _calibration.m_shift = 0;
+    _calibration.m_searchLength = LATENCY_BUFFER_SIZE;
+    _calibrationRecorded.store(false);
+    setOperationMode(CalibratingLatency);
+
+    // Transforming the recording takes too long for a period, so it is
+    // analyzed here once it is complete.
+    if(mls && !_calibrationTimer)
+        _calibrationTimer = startTimer(CALIBRATION_POLLING_INTERVAL);
+    emit calibrationStarted();
+    return true;
+}
+
+bool EARFilter::startParallelCalibration(MLSAnalyzer *sequence, float *workspace,
+                                         int shift, int slotLength) {
+    if(operationMode() != ProcessingAudio)
+        return false;
+
+    _latencyTracker->reset();
+    _calibration.m_position = 0;
+    _calibration.m_sequence = sequence;
+    _calibration.m_workspace = workspace;
+    _calibration.m_shift = shift;
+    _calibration.m_searchLength = qMin(slotLength, (int)LATENCY_BUFFER_SIZE);
+    _calibrationRecorded.store(false);
+    setOperationMode(CalibratingLatency);
     emit calibrationStarted();
+    return true;
+}
+
+bool EARFilter::calibrationRecorded() {
+    return _calibrationRecorded.load();
+}
+
+bool EARFilter::takeCalibrationRecording() {
+    return _calibrationRecorded.testAndSetOrdered(true, false);
+}
+
+void EARFilter::cancelCalibration(MLSAnalyzer *sequence) {
+    if(_calibration.m_sequence != sequence)
+        return;
+    if(_operationMode.testAndSetRelease(CalibratingLatency, ProcessingAudio))
+        emit calibrationFinished();
+}
+
+void EARFilter::timerEvent(QTimerEvent *timerEvent) {
+    if(timerEvent->timerId() != _calibrationTimer) {
+        QObject::timerEvent(timerEvent);
+        return;
+    }
+
+    if(takeCalibrationRecording()) {
+        analyzeCalibration();
+    } else if(operationMode() == CalibratingLatency) {
+        return;
+    }
+
+    // Either done or the calibration has been abandoned.
+    killTimer(_calibrationTimer);
+    _calibrationTimer = 0;
+}
+
+void EARFilter::analyzeCalibration() {
+    MLSAnalyzer *sequence = _calibration.m_sequence;
+    float *workspace = _calibration.m_workspace;
+
+    sequence->transform(workspace);
+
+    // Leave room for one period, the latency buffer has to reach back
+    // the latency plus the period.
+    int searchLength = qMin(_calibration.m_searchLength,
+                            LATENCY_BUFFER_SIZE - qMax(_blockSize, 1));
+
+    double peakPosition, signalToNoiseRatio;
+    sequence->findPeak(workspace, 0, searchLength,
+                       &peakPosition, &signalToNoiseRatio);
+    _calibration.m_signalToNoiseRatio = signalToNoiseRatio;
+
+    // The peak is the delay from the output to the measured input. The
+    // reference reaches the output through the equalizer, which adds
+    // its own delay.
+    if(signalToNoiseRatio >= MLS_MINIMUM_SNR) {
+        _calibration.m_preciseLatency = peakPosition + _digitalEqualizer.groupDelay();
+        _calibration.m_latency = qRound(_calibration.m_preciseLatency);
+    } else {
+        qDebug() << _name << ": MLS calibration failed, SNR is only"
+                 << signalToNoiseRatio << "dB.";
+    }
+
+    setOperationMode(ProcessingAudio);
+    emit calibrationFinished();
+}
+
+bool EARFilter::startMeasurement() {
+    // The process callback uses the measurement until it switches back to
+    // processing audio, so it must not be restarted or replaced before.
+    if(operationMode() != ProcessingAudio)
+        return false;
+
+    // The measurement plans its transforms and allocates, so set it up here
+    // instead of the audio thread.
+    if(_sweepMeasurement && _sweepMeasurement->sampleRate() != _sampleRate) {
+        delete _sweepMeasurement;
+        _sweepMeasurement = 0;
+    }
+    if(!_sweepMeasurement) {
+        _sweepMeasurement = new SweepMeasurement(_sampleRate, SWEEP_DURATION,
+                                                 20.0, qMin(20000.0, 0.45 * _sampleRate));
+    }
+
+    // Place the window shortly before the direct sound arrives.
+    int directSound = latency() - _digitalEqualizer.groupDelay();
+    _sweepMeasurement->start(qMax(0, directSound - SWEEP_PRE_DELAY));
+
+    _latencyTracker->reset();
+    setOperationMode(MeasuringImpulseResponse);
+    return true;
+}
+
+const SweepMeasurement *EARFilter::sweepMeasurement() {
+    return _sweepMeasurement;
+}
+
+void EARFilter::setSampleRate(int sampleRate) {
+    _sampleRate = sampleRate;
+    _digitalEqualizer.setSampleRate(sampleRate);
+}
+
+void EARFilter::setNoiseSeed(uint32_t seed, int channel) {
+    int substream = channel * NOISE_SUBSTREAMS;
+    _noiseFeeder->seed(seed, substream);
+    _noiseGenerator.seed(seed, substream + NoiseFeeder::SUBSTREAMS);
+
+    // Identical periodic noise on all channels would be fully correlated.
+    _periodicNoise.synthesize(seed + 0x9e3779b9u * channel);
 }
 
 void EARFilter::setModeToRectification() {
-    _operationMode = ProcessingAudio;
+    setOperationMode(ProcessingAudio);
     _calibration.m_waitingForClick = false;
-    _calibration.m_latencyMeasures.clear();
-    _calibration.m_weightedMeasures.clear();
+    _calibration.m_numberOfMeasures = 0;
 }
 
 void EARFilter::setAutomaticAdaptionActive(bool on) {
-    SemaphoreLocker locker(m_automaticAdaptionSemaphore);
-    _adaptionActive = on;
+    _adaptionActive.store(on);
+
+    // Switching the adaption on always starts adapting.
+    if(on)
+        setAdaptionState(AdaptionRunning);
+}
+
+void EARFilter::setAdaptionState(AdaptionState adaptionState) {
+    if(_adaptionState.fetchAndStoreOrdered(adaptionState) != adaptionState)
+        emit adaptionStateChanged();
 }
 
 void EARFilter::setBypassActive(bool on) {
-    SemaphoreLocker locker(m_bypassSemaphore);
-    _bypassActive = on;
+    _bypassActive.store(on);
+}
+
+void EARFilter::setLatencyTrackingActive(bool on) {
+    if(on) {
+        if(!_latencyTracker->isRunning()) {
+            _latencyTracker->reset();
+            _latencyTracker->start(QThread::LowPriority);
+        }
+        _latencyTrackingActive.store(true);
+    } else {
+        // Stop feeding the tracker before stopping it. Whatever is left in
+        // its ring buffers is discarded when it is started again.
+        _latencyTrackingActive.store(false);
+        _latencyTracker->requestInterruption();
+        _latencyTracker->wait();
+    }
 }
 
-void EARFilter::fetchInputBuffers(int samples) {
-    FFTWAdapter::blit(
-        (jack_default_audio_sample_t*)_in.buffer(samples).internalMemory(),
-        _measuredSignalBuffer,
-        samples);
+void EARFilter::fetchPortBuffers(int samples) {
+    // Work directly on the JACK port buffers, there is no need to copy
+    // the signals around as long as we are in the time domain.
+    _measuredSignal = (jack_default_audio_sample_t*)_in.buffer(samples).internalMemory();
+    _outputSignal = (jack_default_audio_sample_t*)_out.buffer(samples).internalMemory();
 
     switch(signalSource()) {
     case ExternalSource: {
         // When transferring music, read directly from JACK buffers.
-        FFTWAdapter::blit(
-            (jack_default_audio_sample_t*)_ref.buffer(samples).internalMemory(),
-            _referenceSignalBuffer,
-            samples
-        );
+        _referenceSignal = (jack_default_audio_sample_t*)_ref.buffer(samples).internalMemory();
         break;
         }
     case WhiteNoise: {
-        _noiseGenerator.process(samples, _noiseBuffer, 0, 0, 0);
-        FFTWAdapter::blit(_noiseBuffer, _referenceSignalBuffer, samples);
+        // Usually the noise has been generated ahead and is only copied.
+        if(!_noiseFeeder->read(NoiseFeeder::White, _noiseBuffer, samples))
+            _noiseGenerator.processWhite(samples, _noiseBuffer);
+        _referenceSignal = _noiseBuffer;
         break;
         }
     case PinkNoise: {
-        _noiseGenerator.process(samples, 0, 0, _noiseBuffer, 0);
-        FFTWAdapter::blit(_noiseBuffer, _referenceSignalBuffer, samples);
+        if(!_noiseFeeder->read(NoiseFeeder::Pink, _noiseBuffer, samples))
+            _noiseGenerator.processPink(samples, _noiseBuffer);
+        _referenceSignal = _noiseBuffer;
+        break;
+        }
+    case PeriodicWhiteNoise:
+    case PeriodicPinkNoise: {
+        // A period is exactly one frame, so the table is used as it is.
+        PeriodicNoise::Color color = signalSource() == PeriodicWhiteNoise ?
+                                     PeriodicNoise::White : PeriodicNoise::Pink;
+        _referenceSignal = _periodicNoise.table(color, samples);
+        if(!_referenceSignal) {
+            _periodicNoise.process(color, _noiseBuffer, samples);
+            _referenceSignal = _noiseBuffer;
+        }
         break;
         }
     }
-
-    updateInputPeaks(samples);
 }
 
-void EARFilter::writeOutputBuffers(int samples) {
-    updateOutputPeaks(samples);
+void EARFilter::trackLatency(int samples) {
+    if(!latencyTrackingActive())
+        return;
 
-    // Write result into the output buffers.
-    FFTWAdapter::blit(
-        _outputSignalBuffer,
-        (jack_default_audio_sample_t*)_out.buffer(samples).internalMemory(),
-        samples
-    );
+    _latencyTracker->write(_referenceSignal, _measuredSignal, samples);
+
+    // Follow a new estimate gradually instead of jumping to it.
+    int trackedLatency = _latencyTracker->latency();
+    if(trackedLatency >= 0) {
+        int difference = trackedLatency - _calibration.m_latency;
+        _calibration.m_latency += qBound(-LATENCY_SLEW_RATE, difference, LATENCY_SLEW_RATE);
+    }
 }
 
 void EARFilter::updateInputPeaks(int samples) {
-    int measuredSignalLevel = 0, referenceSignalLevel = 0;
-    double previous, current;
-
-    for(int i = 0; i < samples; i++) {
-        previous = measuredSignalLevel, current = abs(100 * _measuredSignalBuffer[i][0]);
-        measuredSignalLevel = previous > current ? previous : current;
-        previous = referenceSignalLevel, current = abs(100 * _referenceSignalBuffer[i][0]);
-        referenceSignalLevel = previous > current ? previous : current;
-    }
+    int measuredSignalLevel = 100 * _kernels->peak(_measuredSignal, samples);
+    int referenceSignalLevel = 100 * _kernels->peak(_referenceSignal, samples);
 
     double slow = 0.9;
 
@@ -179,13 +581,7 @@ void EARFilter::updateInputPeaks(int samples) {
 }
 
 void EARFilter::updateOutputPeaks(int samples) {
-    int outputSignalLevel = 0;
-    double previous, current;
-
-    for(int i = 0; i < samples; i++) {
-        previous = outputSignalLevel, current = abs(100 * _outputSignalBuffer[i][0]);
-        outputSignalLevel = previous > current ? previous : current;
-    }
+    int outputSignalLevel = 100 * _kernels->peak(_outputSignal, samples);
 
     double slow = 0.9;
 
@@ -193,90 +589,266 @@ void EARFilter::updateOutputPeaks(int samples) {
     emit outputSignalLevelChanged(_outputSignalLevel);
 }
 
-void EARFilter::processRectification(int samples) {
-    fetchInputBuffers(samples);
-
-    // Shift samples of the reference signals into the latency buffers.
-    for(int i = 0; i < samples; i++) {
-        _latencyBuffer.append(_referenceSignalBuffer[i][0]);
-    }
-
-    // Drops samples that are older than 44100 samples.
-    while(_latencyBuffer.size() > 44100)
-        _latencyBuffer.removeFirst();
-
-    if(automaticAdaptionActive()) {
-        // As soon as we have enogh samples accumulated, we can start to compare.
-        if(_latencyBuffer.size() > (latency() - samples)) {
-            // Extract delayed samples ready for a comparison.
-            for(int i = 0; i < samples; i++) {
-                m_delayedSignalSource[i][0]
-                    = _latencyBuffer.at(_latencyBuffer.size() - latency() - samples + i);
-                m_delayedSignalSource[i][1] = 0;
-            }
+void EARFilter::processRectification(int samples,
+                                     const fftw_complex *measuredSpectrum,
+                                     const fftw_complex *referenceSpectrum) {
+    updateInputPeaks(samples);
 
-            // Get the spectrum by performing the dft.
-            FFTWAdapter::performFFT(_measuredSignalBuffer, m_microphoneFrequencyDomain, samples);
-            FFTWAdapter::performFFT(m_delayedSignalSource, m_signalSourceFrequencyDomain, samples);
-
-            // Gain exclusive access to equalizer controls.
-            _digitalEqualizer.acquireControls();
-            double *equalizerControls = _digitalEqualizer.controls();
-
-            // Compare microphone signal and signal source (ie. music signal).
-            for(int i = 0; i < 2048; i++) {
-                double microphoneAmplitude
-                    = sqrt(m_microphoneFrequencyDomain[i][0]
-                         * m_microphoneFrequencyDomain[i][0]
-                         + m_microphoneFrequencyDomain[i][1]
-                         * m_microphoneFrequencyDomain[i][1]);
-                double signalAmplitude
-                    = sqrt(m_signalSourceFrequencyDomain[i][0]
-                         * m_signalSourceFrequencyDomain[i][0]
-                         + m_signalSourceFrequencyDomain[i][1]
-                         * m_signalSourceFrequencyDomain[i][1]);
-
-                equalizerControls[i]
-                    += (signalAmplitude - microphoneAmplitude) / 2
-                        / (double)((2049 - i));
-            }
+    bool adapting = automaticAdaptionActive();
+    if(_analysisPending && measuredSpectrum && referenceSpectrum) {
+        // Gain exclusive access to equalizer controls.
+        _digitalEqualizer.acquireControls();
+        double *equalizerControls = _digitalEqualizer.controls();
+
+        // Find the bins of each control band. The real fft only yields
+        // the bins up to the nyquist frequency.
+        const ControlGrid &controlGrid = _digitalEqualizer.controlGrid();
+        int bands = controlGrid.bands();
+        controlGrid.binRanges((double)controlGrid.sampleRate() / samples,
+                              samples / 2 + 1, _bandRanges);
+
+        // Adaption state gathered with a different latency, by the other
+        // engine or on other bands does not describe the current situation.
+        AdaptionEngine engine = adaptionEngine();
+        if(latency() != _estimatorLatency || engine != _activeEngine
+        || bands != _spectralEstimator.bands()) {
+            _spectralEstimator.reset();
+            _blockNLMS.reset();
+            _estimatorLatency = latency();
+            _activeEngine = engine;
+            if(adapting)
+                setAdaptionState(AdaptionRunning);
+        }
 
-            // Average filter for smoothing the controls.
-            for(int i = 1; i < 2047; i++) {
-                equalizerControls[i] = (equalizerControls[i-1]
-                                          + equalizerControls[i]
-                                          + equalizerControls[i+1])
-                                            / 3.0;
+        // The estimate is needed by both engines to judge the convergence.
+        _spectralEstimator.update(referenceSpectrum, measuredSpectrum,
+                                  _bandRanges, bands, samples);
+
+        bool adapted = adapting && adaptionState() == AdaptionRunning;
+        if(adapted) {
+            for(int i = 0; i < bands; i++)
+                _previousControls[i] = equalizerControls[i];
+
+            switch(engine) {
+            case CoherenceWeightedAdaption:
+                adaptCoherenceWeighted(equalizerControls, bands);
+                break;
+            case BlockNLMSAdaption:
+                adaptBlockNLMS(equalizerControls, bands, samples,
+                               measuredSpectrum, referenceSpectrum);
+                break;
+            };
+
+            // Bands edited by hand are left as they are.
+            for(int i = 0; i < bands; i++) {
+                if(_digitalEqualizer.locked(i))
+                    equalizerControls[i] = _previousControls[i];
             }
+        }
 
-            // Limit controls to 0.01 .. 1.0.
-            for(int i = 0; i < 2048; i++) {
-                if(equalizerControls[i] > 1.0)
-                    equalizerControls[i] = 1.0;
-                if(equalizerControls[i] < 0.01)
-                    equalizerControls[i] = 0.01;
+        if(adapting)
+            updateConvergence(equalizerControls, bands, samples, adapted);
+        publishAnalyzerFrame(bands, samples);
+
+        // Only the range of controls that actually moved needs a new filter.
+        if(adapted) {
+            int firstChanged = bands, lastChanged = -1;
+            for(int i = 0; i < bands; i++) {
+                if(equalizerControls[i] != _previousControls[i]) {
+                    if(firstChanged > i)
+                        firstChanged = i;
+                    lastChanged = i;
+                }
             }
-
-            // We're done manipulating the controls, release them.
-            _digitalEqualizer.releaseControls();
+            if(lastChanged >= 0)
+                _digitalEqualizer.markDirty(firstChanged, lastChanged);
         }
 
-        // We're done updating the controls, now generate a new filter.
-        _digitalEqualizer.generateFilter();
+        // We're done manipulating the controls, release them. The equalizer
+        // picks the changes up when processing.
+        _digitalEqualizer.releaseControls();
     }
 
     if(!bypassActive()) {
         // Run signals through equalizers into the output buffers.
-        _digitalEqualizer.process(_referenceSignalBuffer, _outputSignalBuffer, samples);
+        _digitalEqualizer.process(_referenceSignal, _outputSignal, samples);
     } else {
         // Bypass equalizers and copy the signal source in the output buffers.
-        FFTWAdapter::blit(_referenceSignalBuffer, _outputSignalBuffer, samples);
+        _kernels->copy(_referenceSignal, _outputSignal, samples);
     }
 
-    writeOutputBuffers(samples);
+    updateOutputPeaks(samples);
 }
 
 void EARFilter::processCalibration(int samples) {
+    if(_calibration.m_sequence)
+        processMLSCalibration(samples);
+    else
+        processClickCalibration(samples);
+}
+
+void EARFilter::adaptCoherenceWeighted(double *equalizerControls, int bands) {
+    // The estimated transfer function includes the equalizer, so
+    // scaling a control by its inverse makes the band flat. Move
+    // towards that in proportion to how well the measured signal is
+    // explained by the reference. Silent and incoherent bands are
+    // left alone, so they do not drift during quiet passages.
+    for(int i = 0; i < bands; i++) {
+        _bandCorrections[i] = 0.0;
+        _bandWeights[i] = 0.0;
+        if(!_spectralEstimator.active(i))
+            continue;
+
+        double coherence = _spectralEstimator.coherence(i);
+        if(coherence < MINIMUM_COHERENCE)
+            continue;
+
+        double magnitude = _spectralEstimator.magnitude(i);
+        if(magnitude <= 0.0)
+            continue;
+
+        _bandWeights[i] = coherence;
+        _bandCorrections[i] = -ADAPTION_RATE * coherence * log(magnitude);
+    }
+
+    // The windows only depend on the grid.
+    int bandsPerOctave = _digitalEqualizer.controlGrid().bandsPerOctave();
+    if(bands != _adaptionSmoother.size() || bandsPerOctave != _smoothedBandsPerOctave) {
+        _adaptionSmoother.setupLogarithmic(bands, bandsPerOctave, ADAPTION_SMOOTHING);
+        _smoothedBandsPerOctave = bandsPerOctave;
+    }
+
+    // Smooth the corrections over a fraction of an octave, so that
+    // narrow notches of the room do not turn into narrow peaks. Averaging
+    // the weighted corrections by the averaged weights only draws on the
+    // adapted bands, and the skipped bands stay where they are.
+    double smoothedWeights[ControlGrid::MAX_BANDS];
+    _adaptionSmoother.smooth(_bandCorrections, _bandCorrections);
+    _adaptionSmoother.smooth(_bandWeights, smoothedWeights);
+
+    for(int i = 0; i < bands; i++) {
+        if(_bandWeights[i] <= 0.0)
+            continue;
+        equalizerControls[i] *= exp(_bandWeights[i] * _bandCorrections[i] / smoothedWeights[i]);
+
+        // Limit controls to 0.01 .. 1.0.
+        if(equalizerControls[i] > 1.0)
+            equalizerControls[i] = 1.0;
+        if(equalizerControls[i] < 0.01)
+            equalizerControls[i] = 0.01;
+    }
+}
+
+void EARFilter::adaptBlockNLMS(double *equalizerControls, int bands, int samples,
+                               const fftw_complex *measuredSpectrum,
+                               const fftw_complex *referenceSpectrum) {
+    // The per band normalization makes smoothing across bands unnecessary,
+    // the limits are applied while transferring into the controls.
+    _blockNLMS.update(referenceSpectrum, measuredSpectrum,
+                      _bandRanges, bands, samples);
+    _blockNLMS.transferTo(equalizerControls, bands, NLMS_TRANSFER_SHARE, 0.01, 1.0);
+}
+
+void EARFilter::updateConvergence(const double *equalizerControls, int bands,
+                                  int samples, bool adapted) {
+    // The transfer function includes the equalizer, so it is flat once the
+    // room is corrected. Its overall level depends on the gains of the
+    // microphone and the reference, so only the deviation from its mean
+    // counts as error. Bands edited by hand are deliberately not flat, and
+    // bands whose control sits at a limit of 0.01 .. 1.0 cannot be moved
+    // any further towards flat, so they would never let the error settle.
+    double weightSum = 0.0, levelSum = 0.0, squareSum = 0.0;
+    double coherenceSum = 0.0;
+    int activeBands = 0;
+    for(int i = 0; i < bands; i++) {
+        if(!_spectralEstimator.active(i) || _digitalEqualizer.locked(i))
+            continue;
+
+        double coherence = _spectralEstimator.coherence(i);
+        coherenceSum += coherence;
+        activeBands++;
+
+        double magnitude = _spectralEstimator.magnitude(i);
+        if(coherence < MINIMUM_COHERENCE || magnitude <= 0.0)
+            continue;
+        if((equalizerControls[i] >= 1.0 && magnitude < 1.0)
+        || (equalizerControls[i] <= 0.01 && magnitude > 1.0))
+            continue;
+
+        double level = 20.0 * log10(magnitude);
+        weightSum += coherence;
+        levelSum += coherence * level;
+        squareSum += coherence * level * level;
+    }
+
+    // Without a coherent reference there is nothing to judge, so the state
+    // is kept until the signal returns.
+    if(weightSum <= 0.0)
+        return;
+
+    double meanLevel = levelSum / weightSum;
+    double variance = squareSum / weightSum - meanLevel * meanLevel;
+    _convergence.m_spectralError = variance > 0.0 ? sqrt(variance) : 0.0;
+    _convergence.m_coherence = coherenceSum / activeBands;
+
+    if(adapted) {
+        double deltaSum = 0.0;
+        for(int i = 0; i < bands; i++) {
+            double delta = 20.0 * log10(equalizerControls[i] / _previousControls[i]);
+            deltaSum += delta * delta;
+        }
+        _convergence.m_controlDelta = sqrt(deltaSum / bands);
+
+        if(_convergence.m_controlDelta < CONVERGED_CONTROL_DELTA
+        && _convergence.m_spectralError < CONVERGED_SPECTRAL_ERROR) {
+            _convergence.m_stableSamples += samples;
+            if(_convergence.m_stableSamples >= CONVERGENCE_TIME * _sampleRate) {
+                _convergence.m_stableSamples = 0;
+                _convergence.m_skippedPeriods = 0;
+                setAdaptionState(AdaptionFrozen);
+            }
+        } else {
+            _convergence.m_stableSamples = 0;
+        }
+    } else if(_convergence.m_spectralError > RESUME_SPECTRAL_ERROR) {
+        // The room or the signal has changed.
+        setAdaptionState(AdaptionRunning);
+    }
+}
+
+/** @return Level in dB of a power, limited to the floor of the analyzer. */
+static float analyzerLevel(double power) {
+    if(power <= 0.0)
+        return AnalyzerFeed::LEVEL_FLOOR;
+    double level = 10.0 * log10(power);
+    return level > AnalyzerFeed::LEVEL_FLOOR ? level : AnalyzerFeed::LEVEL_FLOOR;
+}
+
+void EARFilter::publishAnalyzerFrame(int bands, int samples) {
+    AnalyzerFeed::Frame *frame = _analyzerFeed.beginFrame(samples, _sampleRate);
+    if(!frame)
+        return;
+
+    // Everything has been estimated for the adaption already.
+    const ControlGrid &controlGrid = _digitalEqualizer.controlGrid();
+    frame->m_bandsPerOctave = controlGrid.bandsPerOctave();
+    frame->m_sampleRate = controlGrid.sampleRate();
+    frame->m_bands = bands;
+    for(int i = 0; i < bands; i++) {
+        frame->m_referenceLevel[i] = analyzerLevel(_spectralEstimator.referencePower(i));
+        frame->m_measuredLevel[i] = analyzerLevel(_spectralEstimator.measuredPower(i));
+        if(_spectralEstimator.active(i)) {
+            double magnitude = _spectralEstimator.magnitude(i);
+            frame->m_transferLevel[i] = analyzerLevel(magnitude * magnitude);
+        } else {
+            frame->m_transferLevel[i] = AnalyzerFeed::LEVEL_FLOOR;
+        }
+    }
+
+    _analyzerFeed.publishFrame();
+}
+
+void EARFilter::processClickCalibration(int samples) {
     // The calibration process basically consists of two states:
     // 1.) Sending a signal
     // 2.) Waiting to receive the signal
@@ -291,20 +863,18 @@ void EARFilter::processCalibration(int samples) {
 
         // Generate new click. A click containes a single high sample at the
         // very end of the buffer period.
-        for(int i = 0; i < samples; i++) {
-            _outputSignalBuffer[i][0] = (i < (samples - 1)) ? 0 : 1.0;
-            _outputSignalBuffer[i][1] = 0;
-        }
+        _kernels->silence(_outputSignal, samples);
+        _outputSignal[samples - 1] = 1.0f;
 
         // Now let's indicate we are waiting for the click to return.
         _calibration.m_waitingForClick = true;
     } else {
-        fetchInputBuffers(samples);
+        updateInputPeaks(samples);
 
         // Find the first occurence of the maximum value.
         int maxLeft = 0;
         for(int i = 0; i < samples; i++) {
-            if(_measuredSignalBuffer[i][0] > _measuredSignalBuffer[maxLeft][0])
+            if(_measuredSignal[i] > _measuredSignal[maxLeft])
                 maxLeft = i;
         }
 
@@ -315,7 +885,7 @@ void EARFilter::processCalibration(int samples) {
         double threshold = 0.8;
         int minLatency = 512;
 
-        if(_measuredSignalBuffer[maxLeft][0] > threshold
+        if(_measuredSignal[maxLeft] > threshold
         && (maxLeft + _calibration.m_offset > minLatency)) {
             // This is an incoming click. Add the offsets to get the absolute
             // latency, because maxLeft and maxRight only contain the samples
@@ -323,28 +893,31 @@ void EARFilter::processCalibration(int samples) {
             maxLeft  += _calibration.m_offset;
 
             // Append the result to the list of measures.
-            _calibration.m_latencyMeasures.append(maxLeft);
+            _calibration.m_latencyMeasures[_calibration.m_numberOfMeasures++] = maxLeft;
 
             // Check if we have enough measures to determine the latency.
-            if(_calibration.m_latencyMeasures.size() > 20) {
+            if(_calibration.m_numberOfMeasures == CALIBRATION_MEASURES) {
                 // Set the mode to Running, we are done with measuring.
-                _operationMode = ProcessingAudio;
-
-                // Assort all measures in a weighted map. That way, we can
-                // see how often a measured value appeared.
-                foreach(int value, _calibration.m_latencyMeasures)
-                    _calibration.m_weightedMeasures[value]++;
+                setOperationMode(ProcessingAudio);
 
                 // Now pick the measured value that appeared most. This is
                 // more precise than just calculating the intermediate value,
                 // because in practice the correct value appears multiple
-                // times.
-                int candidate = 0;
-                QList<int> keysLeft = _calibration.m_weightedMeasures.keys();
-                foreach(int key, keysLeft) {
-                    if(_calibration.m_weightedMeasures[key]
-                        > _calibration.m_weightedMeasures[candidate])
-                        candidate = key;
+                // times. On a tie, the smallest value wins.
+                int candidate = 0, candidateOccurences = 0;
+                for(int i = 0; i < CALIBRATION_MEASURES; i++) {
+                    int value = _calibration.m_latencyMeasures[i];
+                    int occurences = 0;
+                    for(int j = 0; j < CALIBRATION_MEASURES; j++) {
+                        if(_calibration.m_latencyMeasures[j] == value)
+                            occurences++;
+                    }
+
+                    if(occurences > candidateOccurences
+                    || (occurences == candidateOccurences && value < candidate)) {
+                        candidate = value;
+                        candidateOccurences = occurences;
+                    }
                 }
 
                 // Pick the best hit and take it as the latency.
@@ -363,11 +936,75 @@ void EARFilter::processCalibration(int samples) {
         }
 
         // Generate silence, we don't want to send anything out right now.
-        for(int i = 0; i < samples; i++) {
-            _outputSignalBuffer[i][0] = 0;
-            _outputSignalBuffer[i][1] = 0;
+        _kernels->silence(_outputSignal, samples);
+    }
+
+    updateOutputPeaks(samples);
+}
+
+void EARFilter::processMLSCalibration(int samples) {
+    // The sequence is played continuously. After the priming samples the
+    // room is in a steady state, so exactly one period of the recording
+    // contains the circular impulse response of the whole path.
+    MLSAnalyzer *sequence = _calibration.m_sequence;
+    int length = sequence->length();
+    int position = _calibration.m_position;
+
+    updateInputPeaks(samples);
+
+    // Wait in silence while the recording is being analyzed elsewhere.
+    if(position >= MLS_PRIMING + length) {
+        _kernels->silence(_outputSignal, samples);
+        updateOutputPeaks(samples);
+        return;
+    }
+
+    // The recording is accumulated at the same shifted position the
+    // sequence is played at, which puts the response to this channel's
+    // own output at the beginning of the impulse response.
+    sequence->excitation(_outputSignal, position + _calibration.m_shift,
+                         samples, MLS_AMPLITUDE);
+
+    int recordFrom = qMax(position, MLS_PRIMING);
+    int recordTo = qMin(position + samples, MLS_PRIMING + length);
+    if(recordFrom < recordTo) {
+        sequence->accumulate(_calibration.m_workspace,
+                             recordFrom + _calibration.m_shift,
+                             _measuredSignal + recordFrom - position,
+                             recordTo - recordFrom);
+    }
+
+    _calibration.m_position = position + samples;
+
+    // The workspace has been cleared before, and the recording is
+    // analyzed outside of the process callback.
+    if(_calibration.m_position >= MLS_PRIMING + length)
+        _calibrationRecorded.store(true);
+
+    updateOutputPeaks(samples);
+}
+
+void EARFilter::processMeasurement(int samples) {
+    updateInputPeaks(samples);
+
+    if(_sweepMeasurement->process(_measuredSignal, _outputSignal, samples)) {
+        // Seed the controls with the inverse of the measured response, that
+        // is where automatic adaption would converge to.
+        _digitalEqualizer.acquireControls();
+        double *equalizerControls = _digitalEqualizer.controls();
+        const ControlGrid &controlGrid = _digitalEqualizer.controlGrid();
+        double magnitudes[ControlGrid::MAX_BANDS];
+        _sweepMeasurement->controlMagnitudes(controlGrid, magnitudes);
+        for(int i = 0; i < controlGrid.bands(); i++) {
+            equalizerControls[i] = magnitudes[i] > 0.0
+                    ? qBound(0.01, 1.0 / magnitudes[i], 1.0) : 1.0;
         }
+        _digitalEqualizer.markDirty();
+        _digitalEqualizer.releaseControls();
+
+        setOperationMode(ProcessingAudio);
+        emit impulseResponseMeasured();
     }
 
-    writeOutputBuffers(samples);
+    updateOutputPeaks(samples);
 }
@@ -3,22 +3,34 @@
 
 #include "equalizer.h"
 #include "fftwadapter.h"
+#include "dspkernels.h"
+#include "channelarena.h"
+#include "latencytracker.h"
+#include "analyzerfeed.h"
+#include "presetfile.h"
+#include "noisefeeder.h"
+#include "mlsanalyzer.h"
+#include "sweepmeasurement.h"
+#include "spectralestimator.h"
+#include "blocknlms.h"
+#include "spectralsmoother.h"
+#include "periodicnoise.h"
 #include "jnoise/jnoise.h"
 
-#include <Processor>
 #include <AudioPort>
 
-#include <QMap>
+#include <QAtomicInt>
+#include <QTimerEvent>
 
 class EARFilter :
-    public QObject,
-    public QtJack::Processor {
+    public QObject {
     Q_OBJECT
 
 public:
     /** Operating modes. */
     enum OperationMode {
         CalibratingLatency,
+        MeasuringImpulseResponse,
         ProcessingAudio
     };
 
@@ -26,21 +38,161 @@ public:
     enum SignalSource {
         ExternalSource,
         WhiteNoise,
-        PinkNoise
+        PinkNoise,
+        /** Noise repeating with the period of the analysis frames. */
+        PeriodicWhiteNoise,
+        PeriodicPinkNoise
+    };
+
+    /** Engines adapting the equalizer to the measured signal. */
+    enum AdaptionEngine {
+        CoherenceWeightedAdaption,
+        BlockNLMSAdaption
+    };
+
+    /** States of the automatic adaption. */
+    enum AdaptionState {
+        /** The controls follow the measured signal. */
+        AdaptionRunning,
+        /** The controls have converged and are left alone, the measured
+          * signal is only monitored for changes. */
+        AdaptionFrozen
+    };
+
+    /** Methods to calibrate the latency. */
+    enum CalibrationMethod {
+        ClickCalibration,
+        MLSCalibration
     };
 
     EARFilter(QString name, QtJack::AudioPort in, QtJack::AudioPort ref, QtJack::AudioPort out);
 
-    void process(int samples);
+    /** Allocates filters from a locked, pre-faulted arena block, so that
+      * the whole working set of a channel is contiguous in memory. */
+    static void *operator new(size_t size);
+    static void operator delete(void *memory, size_t size);
+
+    /** Destructor. */
+    ~EARFilter();
+
+    /**
+      * First half of processing a period. Fetches the port buffers and, if
+      * automatic adaption needs a spectrum in this period, writes the time
+      * domain analysis frame. Both signals are real, so they are packed into
+      * a single complex frame to be transformed at once.
+      * @param samples Number of samples.
+      * @param frame Receives the measured signal in the real part and the
+      *        delayed reference in the imaginary part.
+      * @return true, if the frame has been written and has to be
+      *         transformed before calling finishProcessing.
+      */
+    bool prepareAnalysis(int samples, fftw_complex *frame);
+
+    /**
+      * Second half of processing a period. Adapts the equalizer and writes
+      * the output port.
+      * @param samples Number of samples.
+      * @param measuredSpectrum Spectrum of the measured frame, or null if
+      *        the frame could not be transformed in this period.
+      * @param referenceSpectrum Spectrum of the reference frame, or null.
+      */
+    void finishProcessing(int samples,
+                          const fftw_complex *measuredSpectrum,
+                          const fftw_complex *referenceSpectrum);
 
     void setSignalSource(SignalSource signalSource);
     EARFilter::SignalSource signalSource();
 
     bool automaticAdaptionActive();
     bool bypassActive();
+    bool latencyTrackingActive();
 
-    /** Resets the calibration. */
-    void startCalibration();
+    void setAdaptionEngine(AdaptionEngine adaptionEngine);
+    EARFilter::AdaptionEngine adaptionEngine();
+
+    /** @return The state of the automatic adaption. */
+    EARFilter::AdaptionState adaptionState();
+
+    /** @return RMS change of the controls in the last adapted period in dB. */
+    double adaptionControlDelta() { return _convergence.m_controlDelta; }
+
+    /** @return Coherence weighted RMS deviation of the measured transfer
+      *         function from flat in dB. */
+    double adaptionSpectralError() { return _convergence.m_spectralError; }
+
+    /** @return Mean coherence over all bands carrying a reference signal. */
+    double adaptionCoherence() { return _convergence.m_coherence; }
+
+    void setCalibrationMethod(CalibrationMethod calibrationMethod);
+    EARFilter::CalibrationMethod calibrationMethod();
+
+    /** Resets the calibration.
+      * @return false, if the channel is calibrating or measuring already. */
+    bool startCalibration();
+
+    /**
+      * Starts a calibration together with other channels. All channels play
+      * the same maximum length sequence, each circularly shifted by its own
+      * offset, so the response of this channel appears in its own slot of
+      * the recording. The analysis is left to analyzeCalibration().
+      * @param sequence Sequence shared by all channels.
+      * @param workspace Zeroed workspace of this channel.
+      * @param shift Offset of the sequence for this channel.
+      * @param slotLength Length of the slots in samples.
+      * @return false, if the channel is calibrating or measuring already.
+      */
+    bool startParallelCalibration(MLSAnalyzer *sequence, float *workspace,
+                                  int shift, int slotLength);
+
+    /** @return true, if an MLS calibration has recorded a full period. */
+    bool calibrationRecorded();
+
+    /**
+      * Claims the recorded period of an MLS calibration for analysis, so
+      * that it is analyzed only once.
+      * @return true, if a recorded period has been claimed.
+      */
+    bool takeCalibrationRecording();
+
+    /** Finishes an MLS calibration by analyzing the recorded period.
+      * Takes too long for the process callback. */
+    void analyzeCalibration();
+
+    /**
+      * Returns to processing audio if the MLS calibration with the given
+      * sequence has not recorded a full period.
+      * @param sequence Sequence of the calibration to cancel.
+      */
+    void cancelCalibration(MLSAnalyzer *sequence);
+
+    /** @return The maximum latency in samples a filter can compensate. */
+    static int maximumLatency() { return LATENCY_BUFFER_SIZE; }
+
+    /**
+      * Measures the impulse response with a sine sweep and seeds the
+      * equalizer controls from it. The latency should have been calibrated
+      * before, as it locates the impulse response in the recording.
+      * @return false, if the channel is calibrating or measuring already.
+      */
+    bool startMeasurement();
+
+    /** @return The last sweep measurement, or null if there has been none.
+      *         Only valid after impulseResponseMeasured(). */
+    const SweepMeasurement *sweepMeasurement();
+
+    /** Sets the sample rate of the JACK server. */
+    void setSampleRate(int sampleRate);
+    int sampleRate() { return _sampleRate; }
+
+    /**
+      * Seeds the noise signal sources. Channels with the same seed and
+      * different channel numbers play independent noise, the same seed and
+      * channel number always play the same noise. Not real time safe, call
+      * before the filter is processed.
+      * @param seed Seed, zero seeds from the current time.
+      * @param channel Channel number, counted from zero.
+      */
+    void setNoiseSeed(uint32_t seed, int channel);
 
     /** Set mode to "Rectification". */
     void setModeToRectification();
@@ -51,6 +203,9 @@ public:
     /** Activates/deactivates bypassing. */
     void setBypassActive(bool on);
 
+    /** Activates/deactivates tracking the latency while music is playing. */
+    void setLatencyTrackingActive(bool on);
+
     /**
      * Provides the latency for the left channel.
      *
@@ -59,13 +214,41 @@ public:
      */
     int latency() { return _calibration.m_latency; }
 
+    /** @return Latency found by the last MLS calibration with sub-sample
+      *         accuracy. Only valid after calibrationFinished(). */
+    double preciseLatency() { return _calibration.m_preciseLatency; }
+
+    /** @return Signal to noise ratio of the impulse response found by the
+      *         last MLS calibration in dB. */
+    double calibrationSignalToNoiseRatio() { return _calibration.m_signalToNoiseRatio; }
+
     Equalizer *equalizer();
 
+    /** Writes the state of the channel into a preset record. */
+    void storePreset(PresetFile::Channel *channel);
+
+    /**
+      * Restores the state of the channel from a preset record. Does not
+      * block the process callback, the latency and the controls are taken
+      * over in one of the next periods.
+      * @return false, if the record is invalid.
+      */
+    bool applyPreset(const PresetFile::Channel &channel);
+
+    /** @return Spectra of the adaption for the analyzer view. */
+    AnalyzerFeed *analyzerFeed();
+
     QString name();
 
+protected:
+    /** Analyzes the recording of a single channel MLS calibration. */
+    void timerEvent(QTimerEvent *timerEvent);
+
 signals:
     void calibrationStarted();
     void calibrationFinished();
+    void impulseResponseMeasured();
+    void adaptionStateChanged();
 
     void referenceSignalLevelChanged(int level);
     void measuredSignalLevelChanged(int level);
@@ -76,26 +259,84 @@ private:
     QtJack::AudioPort _in, _ref, _out;
 
     Equalizer _digitalEqualizer;
-    JNoise _noiseGenerator;
-
-    OperationMode _operationMode;
-    SignalSource m_signalSource;
 
-    QSemaphore *m_signalSourceSemaphore;
-    QSemaphore *m_automaticAdaptionSemaphore;
-    QSemaphore *m_bypassSemaphore;
+    /** Number of noise substreams of a seed used per channel. */
+    static const int NOISE_SUBSTREAMS = NoiseFeeder::SUBSTREAMS + 1;
 
-    /** Automatic adaption state. */
-    bool _adaptionActive;
-    /** Bypass state. */
-    bool _bypassActive;
+    /** Generates the noise ahead in the background. */
+    NoiseFeeder *_noiseFeeder;
+    /** Generates the noise in the process callback when the feeder lags behind. */
+    JNoise _noiseGenerator;
+    PeriodicNoise _periodicNoise;
+
+    /** Operation mode. Stored with release semantics, so that the state
+      * of the mode written before is visible to the process callback. */
+    QAtomicInt _operationMode;
+    OperationMode operationMode() { return (OperationMode)_operationMode.loadAcquire(); }
+    void setOperationMode(OperationMode operationMode) { _operationMode.storeRelease(operationMode); }
+
+    /** Signal source, shared with the GUI. */
+    QAtomicInt m_signalSource;
+
+    /** Automatic adaption state, shared with the GUI. */
+    QAtomicInt _adaptionActive;
+    /** Bypass state, shared with the GUI. */
+    QAtomicInt _bypassActive;
+    /** Latency tracking state, shared with the GUI. */
+    QAtomicInt _latencyTrackingActive;
+    /** Adaption state, shared with the GUI. */
+    QAtomicInt _adaptionState;
+    /** Calibration method, shared with the GUI. */
+    QAtomicInt _calibrationMethod;
+    /** Set when an MLS calibration has recorded a full period. */
+    QAtomicInt _calibrationRecorded;
+
+    /** Interval in milliseconds to check for a recorded MLS period. */
+    static const int CALIBRATION_POLLING_INTERVAL = 50;
+
+    /** Timer checking for the recording of a single channel MLS
+      * calibration, zero if not running. */
+    int _calibrationTimer;
+    /** Latency to be taken over by the process callback, -1 if none. */
+    QAtomicInt _requestedLatency;
+
+    /** Maximum change of the latency per period when following the tracker. */
+    static const int LATENCY_SLEW_RATE = 64;
+
+    /** Tracks the latency in the background during normal operation. */
+    LatencyTracker *_latencyTracker;
+
+    /** Spectra handed over to the analyzer view. */
+    AnalyzerFeed _analyzerFeed;
 
     int _measuredSignalLevel;
     int _referenceSignalLevel;
     int _outputSignalLevel;
 
-    /** Latency buffer for the reference input. */
-    QList<double> _latencyBuffer;
+    /** Size of the latency buffer, the maximum latency in samples. */
+    static const int LATENCY_BUFFER_SIZE = 44100;
+
+    /** Number of measures taken during a calibration. */
+    static const int CALIBRATION_MEASURES = 21;
+
+    /** Order of the maximum length sequence, 65535 samples per period. */
+    static const int MLS_ORDER = 16;
+
+    /** Samples the sequence is played before recording, so that the room
+      * is excited for the maximum latency when the recording starts. */
+    static const int MLS_PRIMING = LATENCY_BUFFER_SIZE;
+
+    /** Amplitude of the sequence. */
+    static const float MLS_AMPLITUDE;
+
+    /** Minimum signal to noise ratio in dB to accept an MLS measurement. */
+    static const double MLS_MINIMUM_SNR;
+
+    /** Latency buffer for the reference input, used as a ring buffer. */
+    jack_default_audio_sample_t _latencyBuffer[LATENCY_BUFFER_SIZE];
+
+    /** Position of the next sample written into the latency buffer. */
+    int _latencyBufferPosition;
 
     /** This struct contains attributes that refer
       * to the calibration process. */
@@ -108,33 +349,187 @@ private:
           * a sample buffer period. */
         int m_offset;
         /** All previous latency measures. */
-        QVector<int> m_latencyMeasures;
-        /** Weighted map that correlates the number of occurences
-          * of a measure to the measure itself. */
-        QMap<int, int> m_weightedMeasures;
+        int m_latencyMeasures[CALIBRATION_MEASURES];
+        /** Number of latency measures taken so far. */
+        int m_numberOfMeasures;
+        /** Samples played from the maximum length sequence so far. */
+        int m_position;
+        /** Latency of the last MLS calibration with sub-sample accuracy. */
+        double m_preciseLatency;
+        /** Signal to noise ratio of the last MLS calibration in dB. */
+        double m_signalToNoiseRatio;
+        /** Sequence played during MLS calibration, null for clicks. */
+        MLSAnalyzer *m_sequence;
+        /** Workspace the recording is accumulated in. */
+        float *m_workspace;
+        /** Offset of the sequence for this channel. */
+        int m_shift;
+        /** Length of the range the impulse response is searched in. */
+        int m_searchLength;
     } _calibration;
 
-    fftw_complex _measuredSignalBuffer[4096];
-    fftw_complex _referenceSignalBuffer[4096];
-    fftw_complex _outputSignalBuffer[4096];
+    /** Recovers the impulse response during MLS calibration. */
+    MLSAnalyzer *_mlsAnalyzer;
+
+    /** Workspace the recorded sequence is accumulated in. */
+    float *_mlsWorkspace;
+
+    /** Duration of the measurement sweep in seconds. */
+    static const double SWEEP_DURATION;
+
+    /** Time the impulse response window starts before the direct sound. */
+    static const int SWEEP_PRE_DELAY = 512;
+
+    /** Measures the impulse response with a sine sweep. */
+    SweepMeasurement *_sweepMeasurement;
+
+    /** Sample rate of the JACK server. */
+    int _sampleRate;
+
+    /** JACK port buffers of the current period. The reference signal
+      * points to the noise buffer when noise is used as signal source. */
+    const jack_default_audio_sample_t *_measuredSignal;
+    const jack_default_audio_sample_t *_referenceSignal;
+    jack_default_audio_sample_t *_outputSignal;
+
+    /** True if analysis frames have been prepared for this period. */
+    bool _analysisPending;
+
+    /** Window applied to the analysis frames. Hann, or rectangular for
+      * periodic noise, which fits exactly into a frame. */
+    double _analysisWindow[4096];
+
+    /** True if the analysis window is rectangular. */
+    bool _rectangularWindow;
+
+    /** Averages the spectra of the analysis frames. */
+    SpectralEstimator _spectralEstimator;
+
+    /** Adapts the equalizer with the frequency domain block NLMS. */
+    BlockNLMS _blockNLMS;
+
+    /** Bins of the analysis spectra belonging to each control band. */
+    ControlGrid::BinRange _bandRanges[ControlGrid::MAX_BANDS];
+
+    /** Smooths the corrections of the coherence weighted adaption. */
+    SpectralSmoother _adaptionSmoother;
 
-    fftw_complex m_microphoneFrequencyDomain[4096];
-    fftw_complex m_signalSourceFrequencyDomain[4096];
-    fftw_complex m_delayedSignalSource[4096];
+    /** Resolution of the grid the smoother has been set up for. */
+    int _smoothedBandsPerOctave;
+
+    /** Logarithmic correction of each control band. */
+    double _bandCorrections[ControlGrid::MAX_BANDS];
+
+    /** Weight of the correction of each control band, zero if skipped. */
+    double _bandWeights[ControlGrid::MAX_BANDS];
+
+    /** Latency the adaption state has been gathered with. */
+    int _estimatorLatency;
+
+    /** Adaption engine, shared with the GUI. */
+    QAtomicInt _adaptionEngine;
+
+    /** Engine the adaption state has been gathered by. */
+    AdaptionEngine _activeEngine;
+
+    /** Share of the block NLMS correction moved into the controls per
+      * period, as an exponent of its magnitude. */
+    static const double NLMS_TRANSFER_SHARE;
+
+    /** Share of the correction towards the estimated transfer function
+      * applied per period for a fully coherent bin. */
+    static const double ADAPTION_RATE;
+
+    /** The corrections are smoothed over this fraction of an octave. */
+    static const double ADAPTION_SMOOTHING;
+
+    /** Bins with a lower coherence are not adapted. This corresponds to a
+      * signal to noise ratio of 0 dB. */
+    static const double MINIMUM_COHERENCE;
+
+    /** The adaption freezes when the control delta and the spectral error
+      * stay below these limits in dB for CONVERGENCE_TIME seconds. */
+    static const double CONVERGED_CONTROL_DELTA;
+    static const double CONVERGED_SPECTRAL_ERROR;
+    static const double CONVERGENCE_TIME;
+
+    /** The adaption resumes when the spectral error in dB grows above this. */
+    static const double RESUME_SPECTRAL_ERROR;
+
+    /** Only every n-th period is analyzed while the adaption is frozen. */
+    static const int MONITOR_DECIMATION = 8;
+
+    /** This struct contains attributes that refer
+      * to the convergence of the automatic adaption. */
+    struct Convergence {
+        /** RMS change of the controls in the last adapted period in dB. */
+        double m_controlDelta;
+        /** Deviation of the transfer function from flat in dB. */
+        double m_spectralError;
+        /** Mean coherence over all bands carrying a reference signal. */
+        double m_coherence;
+        /** Samples the metrics have stayed below the limits so far. */
+        int m_stableSamples;
+        /** Periods skipped since the last analysis while frozen. */
+        int m_skippedPeriods;
+    } _convergence;
+
+    /** Controls before adapting them, to measure the change. */
+    double _previousControls[ControlGrid::MAX_BANDS];
 
     jack_default_audio_sample_t _noiseBuffer[4096];
 
-    /** This method will fetch all input buffers to be ready for processing. */
-    void fetchInputBuffers(int samples);
-    void writeOutputBuffers(int samples);
+    /** Block size the kernel table has been picked for. */
+    int _blockSize;
+
+    /** Kernels specialized for the current block size. */
+    const DSPKernels::KernelTable *_kernels;
+
+    /** This method will fetch all port buffers to be ready for processing. */
+    void fetchPortBuffers(int samples);
+
+    /** Feeds the latency tracker and follows its estimate. */
+    void trackLatency(int samples);
 
     void updateInputPeaks(int samples);
     void updateOutputPeaks(int samples);
 
     /** Processes audio. */
-    void processRectification(int samples);
+    void processRectification(int samples,
+                              const fftw_complex *measuredSpectrum,
+                              const fftw_complex *referenceSpectrum);
+    /** Adapts the controls towards the coherence weighted H1 estimate. */
+    void adaptCoherenceWeighted(double *equalizerControls, int bands);
+    /** Adapts the controls with the frequency domain block NLMS. */
+    void adaptBlockNLMS(double *equalizerControls, int bands, int samples,
+                        const fftw_complex *measuredSpectrum,
+                        const fftw_complex *referenceSpectrum);
+
+    /**
+      * Updates the convergence metrics and freezes or resumes the adaption.
+      * @param equalizerControls Controls after this period.
+      * @param bands Number of bands.
+      * @param samples Number of samples of the period.
+      * @param adapted True, if the controls have been adapted this period.
+      */
+    void updateConvergence(const double *equalizerControls, int bands,
+                           int samples, bool adapted);
+
+    /** Publishes the spectra of this period to the analyzer, if a frame
+      * is due. Expects the controls to be acquired. */
+    void publishAnalyzerFrame(int bands, int samples);
+
+    /** Changes the adaption state and notifies the GUI. */
+    void setAdaptionState(AdaptionState adaptionState);
+
     /** Processes calibration. */
     void processCalibration(int samples);
+    /** Calibrates by sending clicks. */
+    void processClickCalibration(int samples);
+    /** Calibrates by playing a maximum length sequence. */
+    void processMLSCalibration(int samples);
+    /** Measures the impulse response. */
+    void processMeasurement(int samples);
 };
 
 #endif // EARFILTER_H
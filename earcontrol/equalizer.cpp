@@ -40,6 +40,7 @@
 #include <QFile>
 #include <QDebug>
 #include <QStringList>
+#include <QThread>
 
 #include <cmath>
 
@@ -47,34 +48,212 @@
 #include "semaphorelocker.h"
 
 Equalizer::Equalizer() {
-    m_numberOfControls = MAX_NUMBER_OF_CONTROLS;
-    for(int i = 0; i < MAX_NUMBER_OF_CONTROLS * 2; i++) {
-        m_delayLine[i] = 0.0;
+    Q_STATIC_ASSERT(FILTER_SPREAD * 2 + 1 == DSPKernels::FILTER_TAPS);
+
+    m_numberOfControls = m_controlGrid.bands();
+    setupFilterInterpolation(m_controlGrid, m_filterBands, m_filterWeights, m_bandFirstBins);
+    m_gridChange.m_grid = m_controlGrid;
+    m_gridChange.m_hasCoefficients = false;
+    m_gridChange.m_appliedVersion = 0;
+    m_gridChangeSemaphore = new QSemaphore(1);
+    m_gridChangePending.store(false);
+    m_bankIdealFilter = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * FILTER_RESOLUTION * 2);
+    m_bankImpulseResponse = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * FILTER_RESOLUTION * 2);
+    {
+        SemaphoreLocker locker(FFTWAdapter::plannerSemaphore());
+        Q_UNUSED(locker);
+        m_inversePlan = fftw_plan_dft_1d(FILTER_RESOLUTION * 2, m_idealFilter, m_ifftIdealFilter,
+                                         FFTW_BACKWARD, FFTW_ESTIMATE);
+        m_bankPlan = fftw_plan_dft_1d(FILTER_RESOLUTION * 2, m_bankIdealFilter, m_bankImpulseResponse,
+                                      FFTW_BACKWARD, FFTW_ESTIMATE);
+    }
+    m_dirtyFirst = MAX_NUMBER_OF_CONTROLS;
+    m_dirtyLast = -1;
+    m_filterVersion = 0;
+    m_controlsVersion.store(0);
+    m_redesignInterval.store(DEFAULT_REDESIGN_INTERVAL);
+    m_snapshotSequence.store(0);
+    m_presetVersion = -1;
+    m_samplesSinceRedesign = 0;
+    for(int i = 0; i < FILTER_SPREAD * 2 + DSPKernels::MAX_BLOCK_SIZE; i++) {
+        m_history[i] = 0.0;
     }
+    m_blockSize = 0;
+    m_kernels = DSPKernels::kernelTable(m_blockSize);
     m_numberOfControlsAccessSemaphore = new QSemaphore(1);
     m_controlsAccessSemaphore = new QSemaphore(1);
+    m_editRingBuffer = jack_ringbuffer_create(MAX_PENDING_EDITS * sizeof(ControlEdit));
+    jack_ringbuffer_mlock(m_editRingBuffer);
+
+    m_bankAccessSemaphore = new QSemaphore(1);
+    for(int i = 0; i < BANK_SIZE; i++)
+        m_bankReady[i] = false;
+    m_selectedBank.store(LIVE_FILTER);
+    m_playingBank.store(LIVE_FILTER);
+    m_crossfadeTime.store(DEFAULT_CROSSFADE_TIME);
+    m_crossfadeLength = 0;
+    m_crossfadeRemaining = 0;
     acquireControls();
     for(int i = 0; i < MAX_NUMBER_OF_CONTROLS; i++) {
         m_controls[i] = 1.0;
+        m_locked[i] = false;
     }
+    markDirty();
     releaseControls();
     generateFilter();
 }
 
 Equalizer::~Equalizer() {
+    {
+        SemaphoreLocker locker(FFTWAdapter::plannerSemaphore());
+        Q_UNUSED(locker);
+        fftw_destroy_plan(m_inversePlan);
+        fftw_destroy_plan(m_bankPlan);
+    }
+    jack_ringbuffer_free(m_editRingBuffer);
+    fftw_free(m_bankIdealFilter);
+    fftw_free(m_bankImpulseResponse);
+    delete m_bankAccessSemaphore;
+    delete m_gridChangeSemaphore;
     delete m_numberOfControlsAccessSemaphore;
     delete m_controlsAccessSemaphore;
 }
 
-void Equalizer::setNumberOfControls(int n) {
-    // Add a scope, so the Locker-Object will unlock.
-    {
-        SemaphoreLocker locker(m_numberOfControlsAccessSemaphore);
-        m_numberOfControls = n;
+void Equalizer::setBandsPerOctave(int bandsPerOctave) {
+    changeGrid(bandsPerOctave, sampleRate());
+}
+
+int Equalizer::bandsPerOctave() {
+    SemaphoreLocker locker(m_gridChangeSemaphore);
+    Q_UNUSED(locker);
+    ControlGrid grid;
+    latestControls(&grid, 0);
+    return grid.bandsPerOctave();
+}
+
+void Equalizer::setSampleRate(int sampleRate) {
+    changeGrid(bandsPerOctave(), sampleRate);
+}
+
+int Equalizer::sampleRate() {
+    SemaphoreLocker locker(m_gridChangeSemaphore);
+    Q_UNUSED(locker);
+    ControlGrid grid;
+    latestControls(&grid, 0);
+    return grid.sampleRate();
+}
+
+void Equalizer::changeGrid(int bandsPerOctave, int sampleRate) {
+    SemaphoreLocker locker(m_gridChangeSemaphore);
+    Q_UNUSED(locker);
+
+    ControlGrid previousGrid;
+    double previousControls[MAX_NUMBER_OF_CONTROLS];
+    latestControls(&previousGrid, previousControls);
+
+    // Moving the controls onto the same grid would only cost a redesign.
+    ControlGrid grid;
+    grid.setup(bandsPerOctave, sampleRate);
+    if(grid.bandsPerOctave() == previousGrid.bandsPerOctave()
+    && grid.sampleRate() == previousGrid.sampleRate())
+        return;
+
+    m_gridChange.m_grid = grid;
+    for(int i = 0; i < grid.bands(); i++)
+        m_gridChange.m_controls[i] = previousGrid.interpolate(previousControls, grid.frequency(i));
+    m_gridChange.m_hasCoefficients = false;
+    publishGridChange();
+}
+
+void Equalizer::latestControls(ControlGrid *grid, double *controls) {
+    // A change stays in place after the audio thread has taken it over,
+    // until the snapshot has caught up with it. Reading the snapshot never
+    // blocks the audio thread.
+    ControlsSnapshot snapshot;
+    readSnapshot(&snapshot);
+    if(m_gridChangePending.load() || snapshot.m_version - m_gridChange.m_appliedVersion < 0) {
+        *grid = m_gridChange.m_grid;
+        if(controls) {
+            for(int i = 0; i < grid->bands(); i++)
+                controls[i] = m_gridChange.m_controls[i];
+        }
+        return;
+    }
+
+    grid->setup(snapshot.m_bandsPerOctave, snapshot.m_sampleRate);
+    if(controls) {
+        for(int i = 0; i < snapshot.m_numberOfControls; i++)
+            controls[i] = snapshot.m_controls[i];
+    }
+}
+
+void Equalizer::publishGridChange() {
+    setupFilterInterpolation(m_gridChange.m_grid, m_gridChange.m_filterBands,
+                             m_gridChange.m_filterWeights, m_gridChange.m_bandFirstBins);
+    m_gridChangePending.storeRelease(true);
+}
+
+void Equalizer::applyGridChange() {
+    if(!m_gridChangePending.loadAcquire())
+        return;
+
+    // Someone is preparing another change or accessing the grid or the
+    // controls right now, the change will be taken over in one of the
+    // next periods.
+    if(!m_gridChangeSemaphore->tryAcquire())
+        return;
+    if(!m_numberOfControlsAccessSemaphore->tryAcquire()) {
+        m_gridChangeSemaphore->release();
+        return;
+    }
+    if(!m_controlsAccessSemaphore->tryAcquire()) {
+        m_numberOfControlsAccessSemaphore->release();
+        m_gridChangeSemaphore->release();
+        return;
+    }
+
+    m_controlGrid = m_gridChange.m_grid;
+    m_numberOfControls = m_controlGrid.bands();
+    for(int i = 0; i < m_numberOfControls; i++) {
+        m_controls[i] = m_gridChange.m_controls[i];
+        m_locked[i] = false;
+    }
+    for(int i = 0; i < FILTER_RESOLUTION; i++) {
+        m_filterBands[i] = m_gridChange.m_filterBands[i];
+        m_filterWeights[i] = m_gridChange.m_filterWeights[i];
+    }
+    for(int i = 0; i <= m_numberOfControls; i++)
+        m_bandFirstBins[i] = m_gridChange.m_bandFirstBins[i];
+
+    // Since the amount of controls has changed, generate a new filter to
+    // keep the equalizer in consistent state.
+    markDirty();
+    if(m_gridChange.m_hasCoefficients) {
+        for(int i = 0; i < FILTER_SPREAD * 2 + 1; i++)
+            m_presetCoefficients[i] = m_gridChange.m_coefficients[i];
+        m_presetVersion = m_controlsVersion.load();
+    }
+    m_gridChange.m_appliedVersion = m_controlsVersion.load();
+    m_gridChangePending.store(false);
+
+    releaseControls();
+    m_numberOfControlsAccessSemaphore->release();
+    m_gridChangeSemaphore->release();
+}
+
+void Equalizer::setupFilterInterpolation(const ControlGrid &grid, int *filterBands,
+                                         double *filterWeights, int *bandFirstBins) {
+    grid.interpolationWeights(grid.sampleRate() / 2.0 / FILTER_RESOLUTION,
+                              FILTER_RESOLUTION, filterBands, filterWeights);
+
+    // The bands of the bins ascend, so each band covers a contiguous run
+    // of bins.
+    int bin = 0;
+    for(int band = 0; band <= grid.bands(); band++) {
+        while(bin < FILTER_RESOLUTION && filterBands[bin] < band)
+            bin++;
+        bandFirstBins[band] = bin;
     }
-    // Since the amount of controls has changed, generate a new filter to keep
-    // the equalizer in consistent state.
-    generateFilter();
 }
 
 int Equalizer::numberOfControls() {
@@ -82,6 +261,10 @@ int Equalizer::numberOfControls() {
     return m_numberOfControls;
 }
 
+const ControlGrid &Equalizer::controlGrid() {
+    return m_controlGrid;
+}
+
 void Equalizer::acquireControls() {
     m_controlsAccessSemaphore->acquire();
 }
@@ -94,6 +277,241 @@ void Equalizer::releaseControls() {
     m_controlsAccessSemaphore->release();
 }
 
+void Equalizer::markDirty(int firstControl, int lastControl) {
+    if(firstControl < m_dirtyFirst)
+        m_dirtyFirst = firstControl;
+    if(lastControl > m_dirtyLast)
+        m_dirtyLast = lastControl;
+    m_controlsVersion.ref();
+}
+
+void Equalizer::markDirty() {
+    markDirty(0, MAX_NUMBER_OF_CONTROLS - 1);
+}
+
+bool Equalizer::editControls(double frequency, double value, double width) {
+    ControlEdit edit;
+    edit.m_frequency = frequency;
+    edit.m_value = value;
+    edit.m_width = width;
+    return queueEdit(edit);
+}
+
+bool Equalizer::unlockControls() {
+    ControlEdit edit;
+    edit.m_frequency = 0.0;
+    edit.m_value = 0.0;
+    edit.m_width = 0.0;
+    return queueEdit(edit);
+}
+
+bool Equalizer::queueEdit(const ControlEdit &edit) {
+    if(jack_ringbuffer_write_space(m_editRingBuffer) < sizeof(ControlEdit))
+        return false;
+    jack_ringbuffer_write(m_editRingBuffer, (const char*)&edit, sizeof(ControlEdit));
+    return true;
+}
+
+void Equalizer::applyEdits() {
+    if(jack_ringbuffer_read_space(m_editRingBuffer) < sizeof(ControlEdit))
+        return;
+
+    // Someone is accessing the controls right now, the edits will be
+    // applied in one of the next periods.
+    if(!m_controlsAccessSemaphore->tryAcquire())
+        return;
+
+    ControlEdit edit;
+    while(jack_ringbuffer_read_space(m_editRingBuffer) >= sizeof(ControlEdit)) {
+        jack_ringbuffer_read(m_editRingBuffer, (char*)&edit, sizeof(ControlEdit));
+
+        if(edit.m_frequency <= 0.0) {
+            for(int i = 0; i < m_numberOfControls; i++)
+                m_locked[i] = false;
+            continue;
+        }
+
+        int firstChanged = m_numberOfControls, lastChanged = -1;
+        for(int i = 0; i < m_numberOfControls; i++) {
+            double distance = fabs(log2(m_controlGrid.frequency(i) / edit.m_frequency));
+            if(distance >= edit.m_width)
+                continue;
+
+            double weight = 0.5 + 0.5 * cos(M_PI * distance / edit.m_width);
+            m_controls[i] = (1.0 - weight) * m_controls[i] + weight * edit.m_value;
+            m_locked[i] = true;
+            if(firstChanged > i)
+                firstChanged = i;
+            lastChanged = i;
+        }
+
+        if(lastChanged >= 0)
+            markDirty(firstChanged, lastChanged);
+    }
+
+    releaseControls();
+}
+
+void Equalizer::readSnapshot(ControlsSnapshot *snapshot) {
+    // The snapshot is consistent if no write started or finished while
+    // copying it. Otherwise try again, writes are short and rare.
+    for(;;) {
+        int sequence = m_snapshotSequence.loadAcquire();
+        if(sequence & 1) {
+            QThread::yieldCurrentThread();
+            continue;
+        }
+
+        snapshot->m_version = m_snapshot.m_version;
+        snapshot->m_bandsPerOctave = m_snapshot.m_bandsPerOctave;
+        snapshot->m_sampleRate = m_snapshot.m_sampleRate;
+        snapshot->m_numberOfControls = m_snapshot.m_numberOfControls;
+        int numberOfControls = snapshot->m_numberOfControls < MAX_NUMBER_OF_CONTROLS ?
+                               snapshot->m_numberOfControls : MAX_NUMBER_OF_CONTROLS;
+        for(int i = 0; i < numberOfControls; i++)
+            snapshot->m_controls[i] = m_snapshot.m_controls[i];
+        for(int i = 0; i < FILTER_SPREAD * 2 + 1; i++)
+            snapshot->m_coefficients[i] = m_snapshot.m_coefficients[i];
+
+        if(m_snapshotSequence.fetchAndAddOrdered(0) == sequence)
+            return;
+    }
+}
+
+void Equalizer::beginSnapshot() {
+    // Readers retry until the sequence is even again.
+    m_snapshotSequence.fetchAndAddOrdered(1);
+
+    m_snapshot.m_version = m_filterVersion;
+    m_snapshot.m_bandsPerOctave = m_controlGrid.bandsPerOctave();
+    m_snapshot.m_sampleRate = m_controlGrid.sampleRate();
+    m_snapshot.m_numberOfControls = m_numberOfControls;
+    for(int i = 0; i < m_numberOfControls; i++)
+        m_snapshot.m_controls[i] = m_controls[i];
+}
+
+void Equalizer::finishSnapshot() {
+    for(int i = 0; i < FILTER_SPREAD * 2 + 1; i++)
+        m_snapshot.m_coefficients[i] = m_filterCoefficients[i];
+
+    m_snapshotSequence.fetchAndAddRelease(1);
+}
+
+bool Equalizer::buildBank(int bank, int bandsPerOctave, int sampleRate,
+                          const double *controls, int numberOfControls) {
+    if(bank < 0 || bank >= BANK_SIZE
+    || !controlsFitGrid(bandsPerOctave, sampleRate, numberOfControls))
+        return false;
+    ControlGrid grid;
+    grid.setup(bandsPerOctave, sampleRate);
+
+    // The filter is designed for the current sample rate, whatever rate
+    // the controls have been saved at.
+    double binWidth = this->sampleRate() / 2.0 / FILTER_RESOLUTION;
+
+    SemaphoreLocker locker(m_bankAccessSemaphore);
+    Q_UNUSED(locker);
+
+    for(int i = 0; i < FILTER_RESOLUTION; i++) {
+        m_bankIdealFilter[i][0] = grid.interpolate(controls, i * binWidth);
+        m_bankIdealFilter[i][1] = 0.0;
+        m_bankIdealFilter[FILTER_RESOLUTION * 2 - 1 - i][0] = m_bankIdealFilter[i][0];
+        m_bankIdealFilter[FILTER_RESOLUTION * 2 - 1 - i][1] = 0.0;
+    }
+    fftw_execute(m_bankPlan);
+
+    // The audio thread may still be reading a filter it has been switched
+    // away from, until it has published that it plays another one.
+    if(bankInUse(bank))
+        return false;
+
+    cutFilter(m_bankImpulseResponse, m_bankCoefficients[bank]);
+    m_bankReady[bank] = true;
+    return true;
+}
+
+bool Equalizer::controlsFitGrid(int bandsPerOctave, int sampleRate, int numberOfControls) {
+    if(sampleRate <= 0)
+        return false;
+    ControlGrid grid;
+    grid.setup(bandsPerOctave, sampleRate);
+    return grid.bandsPerOctave() == bandsPerOctave && grid.bands() == numberOfControls;
+}
+
+bool Equalizer::bankInUse(int bank) {
+    return bank == m_selectedBank.loadAcquire() || bank == m_playingBank.loadAcquire();
+}
+
+bool Equalizer::reserveBank(int bank) {
+    SemaphoreLocker locker(m_bankAccessSemaphore);
+    Q_UNUSED(locker);
+
+    if(bank < 0 || bank >= BANK_SIZE || bankInUse(bank))
+        return false;
+    m_bankReady[bank] = false;
+    return true;
+}
+
+bool Equalizer::bankReady(int bank) {
+    SemaphoreLocker locker(m_bankAccessSemaphore);
+    Q_UNUSED(locker);
+    return bank >= 0 && bank < BANK_SIZE && m_bankReady[bank];
+}
+
+bool Equalizer::selectBank(int bank) {
+    SemaphoreLocker locker(m_bankAccessSemaphore);
+    Q_UNUSED(locker);
+
+    if(bank != LIVE_FILTER && (bank < 0 || bank >= BANK_SIZE || !m_bankReady[bank]))
+        return false;
+    m_selectedBank.storeRelease(bank);
+    return true;
+}
+
+void Equalizer::setCrossfadeTime(int milliseconds) {
+    m_crossfadeTime.store(milliseconds);
+}
+
+const double *Equalizer::bankCoefficients(int bank) {
+    return bank == LIVE_FILTER ? m_filterCoefficients : m_bankCoefficients[bank];
+}
+
+void Equalizer::setRedesignInterval(int milliseconds) {
+    m_redesignInterval.store(milliseconds);
+}
+
+bool Equalizer::loadPreset(int bandsPerOctave, int sampleRate, const double *controls,
+                           int numberOfControls, const double *coefficients) {
+    if(!controlsFitGrid(bandsPerOctave, sampleRate, numberOfControls))
+        return false;
+    ControlGrid presetGrid;
+    presetGrid.setup(bandsPerOctave, sampleRate);
+
+    SemaphoreLocker locker(m_gridChangeSemaphore);
+    Q_UNUSED(locker);
+
+    // The controls are placed on the resolution of the preset at the
+    // current sample rate.
+    ControlGrid currentGrid;
+    latestControls(&currentGrid, 0);
+    ControlGrid &grid = m_gridChange.m_grid;
+    grid.setup(bandsPerOctave, currentGrid.sampleRate());
+
+    bool sameSampleRate = sampleRate == grid.sampleRate();
+    for(int i = 0; i < grid.bands(); i++) {
+        m_gridChange.m_controls[i] = sameSampleRate ? controls[i]
+                                   : presetGrid.interpolate(controls, grid.frequency(i));
+    }
+
+    m_gridChange.m_hasCoefficients = sameSampleRate && coefficients;
+    if(m_gridChange.m_hasCoefficients) {
+        for(int i = 0; i < FILTER_SPREAD * 2 + 1; i++)
+            m_gridChange.m_coefficients[i] = coefficients[i];
+    }
+    publishGridChange();
+    return true;
+}
+
 bool Equalizer::saveControlsToFile(QString fileName) {
     QFile file(fileName);
     file.open(QFile::WriteOnly);
@@ -111,16 +529,12 @@ bool Equalizer::loadControlsFromFile(QString fileName) {
     if(file.isOpen()) {
         unserializeCSV(QString::fromLatin1(file.readAll()));
         file.close();
-        generateFilter();
         return true;
     }
     return false;
 }
 
-void Equalizer::generateFilter() {
-    SemaphoreLocker locker(m_numberOfControlsAccessSemaphore);
-    Q_UNUSED(locker);
-
+bool Equalizer::generateFilter() {
     // Control values in frequency domain:
     // amplitude
     //
@@ -137,24 +551,60 @@ void Equalizer::generateFilter() {
     // |
     // +------------------------------------------------> frequency
 
-    // Construct an ideal filter in the frequency domain.
-    acquireControls(); // Lock access to equalizer controls.
-    for(int i = 0; i < m_numberOfControls * 2; i++) {
-        if(i < m_numberOfControls) {
-            // "Draw" frequency response for the equalizer.
-            m_idealFilter[i][0] = m_controls[i];
-            m_idealFilter[i][1] = 0.0; // m_controls[i];
-        } else {
-            // Mirror frequency response for the second half.
-            m_idealFilter[i][0] = m_controls[m_numberOfControls * 2 - 1 - i];
-            m_idealFilter[i][1] = 0.0; // m_controls[m_numberOfControls * 2 - 1 - i];
-        }
+    // Someone is changing the controls right now, so there will be another
+    // change to pick up anyway.
+    if(!m_controlsAccessSemaphore->tryAcquire())
+        return false;
+
+    // Only the bins interpolated from a dirty band have changed. A bin is
+    // interpolated from its band and the band above.
+    int firstBin = 0, lastBin = -1;
+    if(m_dirtyFirst < m_numberOfControls && m_dirtyFirst <= m_dirtyLast) {
+        firstBin = m_dirtyFirst > 0 ? m_bandFirstBins[m_dirtyFirst - 1] : 0;
+        lastBin = m_dirtyLast < m_numberOfControls - 1 ?
+                  m_bandFirstBins[m_dirtyLast + 1] - 1 : FILTER_RESOLUTION - 1;
+    }
+    m_dirtyFirst = MAX_NUMBER_OF_CONTROLS;
+    m_dirtyLast = -1;
+    m_filterVersion = m_controlsVersion.load();
+
+    // Update the ideal filter in the frequency domain.
+    for(int i = firstBin; i <= lastBin; i++) {
+        // "Draw" frequency response for the equalizer by interpolating
+        // between the bands.
+        int band = m_filterBands[i];
+        double weight = m_filterWeights[i];
+        m_idealFilter[i][0] = (1.0 - weight) * m_controls[band]
+                            + weight * m_controls[band + 1];
+        m_idealFilter[i][1] = 0.0;
+    }
+
+    // Mirror frequency response for the second half. Also when a preset is
+    // taken over, later redesigns only mirror their own range.
+    for(int i = firstBin; i <= lastBin; i++) {
+        m_idealFilter[FILTER_RESOLUTION * 2 - 1 - i][0] = m_idealFilter[i][0];
+        m_idealFilter[FILTER_RESOLUTION * 2 - 1 - i][1] = 0.0;
+    }
+
+    // A preset brings the filter along, as long as nothing has changed
+    // since it has been loaded. The ideal filter is kept up to date anyway
+    // for the redesigns to come.
+    bool presetFilter = m_presetVersion == m_filterVersion;
+    if(presetFilter) {
+        for(int i = 0; i < FILTER_SPREAD * 2 + 1; i++)
+            m_filterCoefficients[i] = m_presetCoefficients[i];
     }
+
+    beginSnapshot();
     releaseControls(); // Release equalizer controls.
 
+    if(presetFilter) {
+        finishSnapshot();
+        return true;
+    }
 
     // Translate into the time domain.
-    FFTWAdapter::performInverseFFT(m_idealFilter, m_ifftIdealFilter, m_numberOfControls * 2);
+    fftw_execute(m_inversePlan);
 
     // Time domain signal after inverse DFT:
     // value
@@ -172,12 +622,22 @@ void Equalizer::generateFilter() {
     // |      oo       oo   o ooo o    oo       oo
     // +------------------------------------------------> coefficients
 
-    // Shift and cut coefficients in order to use as a filter.
+    cutFilter(m_ifftIdealFilter, m_filterCoefficients);
+
+    finishSnapshot();
+    return true;
+}
+
+void Equalizer::cutFilter(const fftw_complex *impulseResponse, double *coefficients) {
+    // Shift and cut coefficients in order to use as a filter. Only these
+    // are normalized, the rest of the inverse transform is thrown away.
     for(int i = 0; i < FILTER_SPREAD * 2 + 1; i++)
         if(i < FILTER_SPREAD) {
-            m_filterCoefficients[i] = m_ifftIdealFilter[m_numberOfControls * 2 - FILTER_SPREAD + i][0];
+            coefficients[i] = impulseResponse[FILTER_RESOLUTION * 2 - FILTER_SPREAD + i][0]
+                            / (FILTER_RESOLUTION * 2);
         } else {
-            m_filterCoefficients[i] = m_ifftIdealFilter[i - FILTER_SPREAD][0];
+            coefficients[i] = impulseResponse[i - FILTER_SPREAD][0]
+                            / (FILTER_RESOLUTION * 2);
         }
 
     // Lower filter coefficients by cutting of samples (determined by FILTER_SPREAD)
@@ -199,7 +659,7 @@ void Equalizer::generateFilter() {
 
     // Apply a hamming window
     for(int i = -FILTER_SPREAD; i <= FILTER_SPREAD; i++)
-        m_filterCoefficients[i + FILTER_SPREAD] *= (0.54 + 0.46 * cos(M_PI * i / FILTER_SPREAD));
+        coefficients[i + FILTER_SPREAD] *= (0.54 + 0.46 * cos(M_PI * i / FILTER_SPREAD));
 
     // Apply a hamming windows to smooth the filter, which improves the frequency response a lot:
     // value
@@ -218,19 +678,62 @@ void Equalizer::generateFilter() {
     // +------------------------------------------------> coefficients
 }
 
-void Equalizer::process(fftw_complex *sampleBuffer, fftw_complex *result, int samples) {
-    SemaphoreLocker locker(m_numberOfControlsAccessSemaphore);
-    Q_UNUSED(locker);
+void Equalizer::process(const jack_default_audio_sample_t *sampleBuffer,
+                        jack_default_audio_sample_t *result,
+                        int samples) {
+    // Pick the specialized kernels only when the period size has changed.
+    if(samples != m_blockSize) {
+        m_blockSize = samples;
+        m_kernels = DSPKernels::kernelTable(samples);
+    }
+
+    // Only this thread changes the grid, so it is read unlocked here.
+    applyGridChange();
+    applyEdits();
 
-    for(int i = 0; i < samples; i++) {
-        result[i][0] = 0.0;
-        m_delayLine[0] = sampleBuffer[i][0];
+    // Redesign the filter if the controls have changed, but not more often
+    // than once per redesign interval. A slider being dragged thereby causes
+    // a bounded number of redesigns.
+    int redesignInterval = m_redesignInterval.load() * m_controlGrid.sampleRate() / 1000;
+    if(m_samplesSinceRedesign < redesignInterval)
+        m_samplesSinceRedesign += samples;
+    if(m_controlsVersion.load() != m_filterVersion
+    && m_samplesSinceRedesign >= redesignInterval) {
+        if(generateFilter())
+            m_samplesSinceRedesign = 0;
+    }
+
+    // Switching filters only takes an index. Keep a copy of the previous
+    // filter to fade out before publishing that it is not played anymore.
+    int selectedBank = m_selectedBank.loadAcquire();
+    int playingBank = m_playingBank.load();
+    if(selectedBank != playingBank) {
+        const double *previous = bankCoefficients(playingBank);
+        for(int i = 0; i < FILTER_SPREAD * 2 + 1; i++)
+            m_fadeCoefficients[i] = previous[i];
+        m_playingBank.fetchAndStoreOrdered(selectedBank);
 
-        for(int j = 0; j < FILTER_SPREAD * 2 + 1; j++)
-            result[i][0] += m_filterCoefficients[j] * m_delayLine[j];
+        m_crossfadeLength = m_crossfadeTime.load() * m_controlGrid.sampleRate() / 1000;
+        m_crossfadeRemaining = m_crossfadeLength;
+    }
 
-        for(int j = m_numberOfControls - 2; j >= 0; j--)
-            m_delayLine[j + 1] = m_delayLine[j];
+    const double *coefficients = bankCoefficients(selectedBank);
+    if(m_crossfadeRemaining <= 0) {
+        m_kernels->convolve(coefficients, m_history, sampleBuffer, result, samples);
+        return;
+    }
+
+    // Run the previous filter on a copy of the history, the convolution
+    // shifts the history it is given.
+    for(int i = 0; i < FILTER_SPREAD * 2; i++)
+        m_fadeHistory[i] = m_history[i];
+    m_kernels->convolve(m_fadeCoefficients, m_fadeHistory, sampleBuffer, m_fadeOutput, samples);
+    m_kernels->convolve(coefficients, m_history, sampleBuffer, result, samples);
+
+    for(int i = 0; i < samples && m_crossfadeRemaining > 0; i++) {
+        double weight = (double)m_crossfadeRemaining / m_crossfadeLength;
+        result[i] = weight * m_fadeOutput[i] + (1.0 - weight) * result[i];
+        m_crossfadeRemaining--;
     }
 }
 
@@ -238,15 +741,13 @@ QString Equalizer::serializeCSV() {
     SemaphoreLocker locker(m_numberOfControlsAccessSemaphore);
     Q_UNUSED(locker);
 
-    QString outStream;
+    QStringList values;
+    values.reserve(m_numberOfControls);
     acquireControls();
-    for(int i = 0; i < m_numberOfControls; i++) {
-        outStream += QString("%1").arg(m_controls[i]);
-        if(i < 2047)
-            outStream += "; ";
-    }
+    for(int i = 0; i < m_numberOfControls; i++)
+        values.append(QString::number(m_controls[i]));
     releaseControls();
-    return outStream;
+    return values.join("; ");
 }
 
 void Equalizer::unserializeCSV(QString stream) {
@@ -254,19 +755,28 @@ void Equalizer::unserializeCSV(QString stream) {
     Q_UNUSED(locker);
 
     QStringList splitStream = stream.split(";", QString::SkipEmptyParts);
-    int i = 0;
-    acquireControls();
+    QVector<double> values;
     foreach(QString value, splitStream) {
-        if(i < m_numberOfControls) {
-            bool ok;
-            m_controls[i] = value.toDouble(&ok);
-            if(!ok) {
-                qDebug() << "Error parsing value to double in CSV: " << value;
-            }
-            i++;
-        } else {
-            qDebug() << "CSV file contains more control values than the equalizer has.";
+        bool ok;
+        values.append(value.toDouble(&ok));
+        if(!ok) {
+            qDebug() << "Error parsing value to double in CSV: " << value;
         }
     }
+
+    if(values.isEmpty())
+        return;
+
+    acquireControls();
+    markDirty();
+    if(values.count() == m_numberOfControls) {
+        for(int i = 0; i < m_numberOfControls; i++)
+            m_controls[i] = values.at(i);
+    } else {
+        // Linearly spaced controls, where control i of n was placed at
+        // i / n of the nyquist frequency.
+        double binWidth = m_controlGrid.sampleRate() / 2.0 / values.count();
+        m_controlGrid.reduce(values.constData(), binWidth, values.count(), m_controls);
+    }
     releaseControls();
 }
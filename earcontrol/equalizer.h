@@ -23,7 +23,14 @@
 
 #include <QVector>
 #include <QSemaphore>
+#include <QAtomicInt>
+
+// JACK includes:
+#include <jack/ringbuffer.h>
+
 #include "fftwadapter.h"
+#include "dspkernels.h"
+#include "controlgrid.h"
 
 /**
  * @class Equalizer
@@ -33,22 +40,90 @@
  * @date 09.2011-2016
  *
  * @brief Modifies the frequency spectrum of the sampled audio signal.
+ *
+ * The controls are placed on fractional octave bands, see ControlGrid. The
+ * filter is designed from the controls interpolated onto linearly spaced
+ * bins.
+ *
+ * Whoever changes the controls marks the changed range as dirty. The filter
+ * is redesigned on the audio thread at the beginning of process(), at most
+ * once per redesign interval, so bursts of changes from the adaption, the
+ * GUI or a preset are coalesced into a single redesign.
+ *
+ * Manual edits from the GUI are queued in a lock-free ring buffer and
+ * applied on the audio thread, so the GUI never waits for the controls.
+ * Edited controls are locked against the automatic adaption until they are
+ * unlocked again. Changes of the grid and presets are prepared outside the
+ * audio thread along with the interpolation of the filter design, and the
+ * audio thread takes them over as a whole. It only ever tries to lock, so
+ * it never waits for the GUI.
+ *
+ * Besides the filter designed from the controls, the equalizer holds a bank
+ * of precomputed filters, which are built in the background. Switching
+ * between them only changes an index, the audio thread crossfades from the
+ * previous filter to the new one.
  */
 class Equalizer
 {
 public:
+    /** Maximum number of controls for which memory should be allocated. */
+    static const int MAX_NUMBER_OF_CONTROLS = ControlGrid::MAX_BANDS;
+
+    /** Number of precomputed filters in the bank. */
+    static const int BANK_SIZE = 4;
+
+    /** Bank index of the filter designed from the controls. */
+    static const int LIVE_FILTER = -1;
+
+    /** Copy of the controls the current filter has been designed from. */
+    struct ControlsSnapshot {
+        /** Controls version the snapshot has been taken at. */
+        int m_version;
+        /** Grid the controls are placed on. */
+        int m_bandsPerOctave;
+        int m_sampleRate;
+        /** Number of valid controls. */
+        int m_numberOfControls;
+        double m_controls[MAX_NUMBER_OF_CONTROLS];
+        /** Coefficients of the filter designed from the controls. */
+        double m_coefficients[DSPKernels::FILTER_TAPS];
+    };
+
     /** Constructs a new digital equalizer. */
     Equalizer();
 
     /** Destructor. */
     ~Equalizer();
 
-    /** Sets the number of controls in linear frequency steps. */
-    void setNumberOfControls(int n);
+    /** Sets the resolution of the controls, between 3 and 24 bands per
+      * octave. The current controls are interpolated onto the new bands.
+      * Does not block the audio thread, which takes the new bands over in
+      * one of the next periods. */
+    void setBandsPerOctave(int bandsPerOctave);
 
-    /** Returns the number of controls in linear frequency steps. */
+    /** Returns the number of bands per octave, including a change that has
+      * not been taken over yet. */
+    int bandsPerOctave();
+
+    /** Sets the sample rate, which determines the highest band. Does not
+      * block the audio thread, see setBandsPerOctave(). */
+    void setSampleRate(int sampleRate);
+
+    /** Returns the sample rate, including a change that has not been taken
+      * over yet. */
+    int sampleRate();
+
+    /** Returns the number of controls, one per band. */
     int numberOfControls();
 
+    /** Bands the controls are placed on.
+      * WARNING: Only access the grid while holding the controls, it changes
+      *          along with the number of controls. */
+    const ControlGrid &controlGrid();
+
+    /** Returns the delay of the linear phase filter in samples. */
+    int groupDelay() { return FILTER_SPREAD; }
+
     /** Grants exclusive access access to equalizer controls. Blocks in
       * case anyone else has been accessing these. */
     void acquireControls();
@@ -63,6 +138,107 @@ public:
     /** Releases exclusive access to equalizer controls. */
     void releaseControls();
 
+    /** Marks a range of controls as changed, so that the filter will be
+      * redesigned. Only call this while holding the controls.
+      * @param firstControl First changed control.
+      * @param lastControl Last changed control. */
+    void markDirty(int firstControl, int lastControl);
+
+    /** Marks all controls as changed. Only call this while holding the
+      * controls. */
+    void markDirty();
+
+    /** Returns a counter that is incremented whenever controls change. */
+    int controlsVersion() { return m_controlsVersion.load(); }
+
+    /** Returns a counter that changes whenever a new snapshot of the
+      * controls has been published. */
+    int snapshotVersion() { return m_snapshotSequence.loadAcquire(); }
+
+    /** Reads the snapshot of the controls the current filter has been
+      * designed from, along with the filter. Never blocks the audio thread, which publishes the
+      * snapshot whenever it redesigns the filter.
+      * @param snapshot Receives the snapshot. */
+    void readSnapshot(ControlsSnapshot *snapshot);
+
+    /** Moves the controls around a frequency towards a value and locks
+      * them. The change fades out with a raised cosine towards the edges
+      * of the edited range. Does not block, the edit is applied on the
+      * audio thread.
+      * @param frequency Center frequency of the edit.
+      * @param value New value of the control at the center frequency.
+      * @param width Distance in octaves from the center at which the
+      *        controls are left alone.
+      * @return false, if too many edits are pending. */
+    bool editControls(double frequency, double value, double width);
+
+    /** Unlocks all controls, so the automatic adaption takes them over
+      * again. Does not block, see editControls().
+      * @return false, if too many edits are pending. */
+    bool unlockControls();
+
+    /** Returns true, if the control has been locked by an edit. Only call
+      * this while holding the controls. */
+    bool locked(int control) { return m_locked[control]; }
+
+    /** Designs a filter from controls and stores it in the bank. Takes a
+      * while, call this from a background thread, see FilterBankBuilder.
+      * @param bank Index of the filter in the bank.
+      * @param bandsPerOctave Resolution of the controls.
+      * @param sampleRate Sample rate the controls have been saved at.
+      * @param controls Controls to design the filter from.
+      * @param numberOfControls Number of controls.
+      * @return false, if the filter is playing at the moment or the
+      *         controls do not match their grid. */
+    bool buildBank(int bank, int bandsPerOctave, int sampleRate,
+                   const double *controls, int numberOfControls);
+
+    /** Returns true, if the controls match the grid they have been saved
+      * with, so that buildBank() accepts them. */
+    static bool controlsFitGrid(int bandsPerOctave, int sampleRate, int numberOfControls);
+
+    /** Returns true, if the filter of the bank is selected or playing, so
+      * that buildBank() would refuse to overwrite it. */
+    bool bankInUse(int bank);
+
+    /** Empties a filter of the bank before rebuilding it, so that it cannot
+      * be selected until buildBank() has stored the new filter.
+      * @return false, if the filter is selected or playing at the moment. */
+    bool reserveBank(int bank);
+
+    /** Returns true, if a filter has been stored in the bank. */
+    bool bankReady(int bank);
+
+    /** Switches to a filter of the bank. Does not block.
+      * @param bank Index of the filter in the bank, or LIVE_FILTER.
+      * @return false, if there is no filter in the bank yet. */
+    bool selectBank(int bank);
+
+    /** Returns the index of the selected filter, or LIVE_FILTER. */
+    int selectedBank() { return m_selectedBank.load(); }
+
+    /** Sets the time to crossfade between filters when switching.
+      * @param milliseconds Crossfade time, zero switches immediately. */
+    void setCrossfadeTime(int milliseconds);
+
+    /** Sets the minimum time between two filter redesigns.
+      * @param milliseconds Redesign interval in milliseconds. */
+    void setRedesignInterval(int milliseconds);
+
+    /** Replaces the controls with those of a preset. Controls saved at
+      * another sample rate are interpolated onto the current bands. If the
+      * preset was saved at the current sample rate, the audio thread takes
+      * over the filter coefficients instead of designing the filter again.
+      * Does not block the audio thread, see setBandsPerOctave().
+      * @param bandsPerOctave Resolution of the preset controls.
+      * @param sampleRate Sample rate the preset has been saved at.
+      * @param controls Controls of the preset.
+      * @param numberOfControls Number of controls of the preset.
+      * @param coefficients Filter designed from the controls, may be null.
+      * @return false, if the controls do not match their grid. */
+    bool loadPreset(int bandsPerOctave, int sampleRate, const double *controls,
+                    int numberOfControls, const double *coefficients);
+
     /** Attempts to write control values into a file.
       * @param fileName File name of the file that shall be saved.
       * @return true on success, otherwise false. */
@@ -73,64 +249,241 @@ public:
       * @return true on success, otherwise false. */
     bool loadControlsFromFile(QString fileName);
 
-    /**
-      * Updates the filter from the given set of equalizer control values.
-      * @param values Equalizer control values.
-      */
-    void generateFilter();
-
     /**
       * Processes a given number of samples. In order to function properly,
       * this method expects a consecutive stream of samples. Do not call
       * this method more than once on a given set of samples, since this
       * will lead to erroneous results.
       * @param sampleBuffer Input sample buffer.
-      * @param result Result sample buffer.
+      * @param result Result sample buffer, may be a JACK port buffer.
       * @param samples Number of samples.
       */
-    void process(fftw_complex *sampleBuffer, fftw_complex *result, int samples);
+    void process(const jack_default_audio_sample_t *sampleBuffer,
+                 jack_default_audio_sample_t *result,
+                 int samples);
 
 private:
     /** Serializes equalizer state into a string. */
     QString serializeCSV();
 
-    /** Attempts to restore equalizer state based on the given string. */
+    /** Attempts to restore equalizer state based on the given string. Files
+      * with a different number of values are taken as linearly spaced
+      * controls up to the nyquist frequency, as saved by older versions. */
     void unserializeCSV(QString stream);
 
+    /** Moves the controls onto a new grid. */
+    void changeGrid(int bandsPerOctave, int sampleRate);
+
+    /** Reads the grid and controls the next change builds upon, which are
+      * those of a change that has not reached the snapshot yet, or else
+      * those of the snapshot. Only call this while holding the grid change.
+      * @param grid Receives the grid.
+      * @param controls Receives the controls, may be null. */
+    void latestControls(ControlGrid *grid, double *controls);
+
+    /** Prepares the filter interpolation of the grid change and hands it
+      * over to the audio thread. Only call this while holding the grid
+      * change. */
+    void publishGridChange();
+
+    /** Takes over a pending grid change, unless the grid or the controls
+      * are being accessed at the moment. */
+    void applyGridChange();
+
+    /** Updates the filter from the dirty controls, unless the controls are
+      * being accessed at the moment.
+      * @return true, if the filter has been updated. */
+    bool generateFilter();
+
+    /** Applies the pending edits, unless the controls are being accessed
+      * at the moment. */
+    void applyEdits();
+
+    /** Starts publishing the controls as snapshot. Only call this while
+      * holding the controls. */
+    void beginSnapshot();
+
+    /** Finishes the snapshot with the filter coefficients. */
+    void finishSnapshot();
+
+    /** Shifts, cuts and windows the inverse transform of the ideal filter
+      * into filter coefficients. */
+    static void cutFilter(const fftw_complex *impulseResponse, double *coefficients);
+
+    /** Returns the coefficients of a filter of the bank, or of the filter
+      * designed from the controls. */
+    const double *bankCoefficients(int bank);
+
+    /** Calculates the interpolation of the filter design from the bands.
+      * @param grid Bands to interpolate from.
+      * @param filterBands Receives the lower band of each bin.
+      * @param filterWeights Receives the weight of the upper band of each bin.
+      * @param bandFirstBins Receives the first bin interpolated from each band. */
+    static void setupFilterInterpolation(const ControlGrid &grid, int *filterBands,
+                                         double *filterWeights, int *bandFirstBins);
+
     /** Semaphore for accessing the number of equalizer controls. */
     QSemaphore *m_numberOfControlsAccessSemaphore;
 
     /** Semaphore for accessing the equalizer controls. */
     QSemaphore *m_controlsAccessSemaphore;
 
-    /** Maximum number of controls for which memory should be allocated. */
-    static const int MAX_NUMBER_OF_CONTROLS = 2048;
-
     /** Filter spread. Lower values lead to less computation time. */
     static const int FILTER_SPREAD = 100;
 
+    /** Number of linearly spaced bins the filter is designed from. */
+    static const int FILTER_RESOLUTION = 2048;
+
+    /** Default minimum time between two filter redesigns in milliseconds. */
+    static const int DEFAULT_REDESIGN_INTERVAL = 50;
+
+    /** Number of edits that may be pending. */
+    static const int MAX_PENDING_EDITS = 256;
+
+    /** Manual change of the controls, queued for the audio thread. */
+    struct ControlEdit {
+        /** Center frequency, or zero to unlock all controls. */
+        double m_frequency;
+        double m_value;
+        double m_width;
+    };
+
+    /** Queues an edit for the audio thread. */
+    bool queueEdit(const ControlEdit &edit);
+
     /** Stores the number of controls. */
     int m_numberOfControls;
 
+    /** Bands the controls are placed on. */
+    ControlGrid m_controlGrid;
+
+    /** Lower band and weight of the upper band to interpolate each bin of
+      * the filter design from. */
+    int m_filterBands[FILTER_RESOLUTION];
+    double m_filterWeights[FILTER_RESOLUTION];
+
+    /** First bin of the filter design interpolated from each band. */
+    int m_bandFirstBins[MAX_NUMBER_OF_CONTROLS + 1];
+
+    /** Grid and controls prepared for the audio thread. */
+    struct GridChange {
+        ControlGrid m_grid;
+        double m_controls[MAX_NUMBER_OF_CONTROLS];
+        int m_filterBands[FILTER_RESOLUTION];
+        double m_filterWeights[FILTER_RESOLUTION];
+        int m_bandFirstBins[MAX_NUMBER_OF_CONTROLS + 1];
+        /** Filter of a preset designed from the controls. */
+        bool m_hasCoefficients;
+        double m_coefficients[FILTER_SPREAD * 2 + 1];
+        /** Controls version at which the audio thread has taken it over. */
+        int m_appliedVersion;
+    } m_gridChange;
+
+    /** Semaphore for accessing the grid change. */
+    QSemaphore *m_gridChangeSemaphore;
+
+    /** Set while a grid change waits for the audio thread. */
+    QAtomicInt m_gridChangePending;
+
+    /** Range of controls changed since the last redesign, empty if the
+      * first control is beyond the last. */
+    int m_dirtyFirst;
+    int m_dirtyLast;
+
+    /** Incremented whenever controls change. */
+    QAtomicInt m_controlsVersion;
+
+    /** Controls version the current filter has been designed from. */
+    int m_filterVersion;
+
+    /** Minimum time between two filter redesigns in milliseconds. */
+    QAtomicInt m_redesignInterval;
+
+    /** Sequence lock of the snapshot, odd while it is being written. */
+    QAtomicInt m_snapshotSequence;
+
+    /** Controls published for the GUI. */
+    ControlsSnapshot m_snapshot;
+
+    /** Samples processed since the last redesign. */
+    int m_samplesSinceRedesign;
+
     /** The current filter coefficients for the FIR filter. */
     double m_filterCoefficients[FILTER_SPREAD * 2 + 1];
 
     /**
-      * Delay line for the convolution. This memory makes it possible
-      * to access previous values and thus continous convolution.
+      * History for the convolution. Holds the last input samples of the
+      * previous period followed by the current period, which makes it
+      * possible to access previous values and thus continous convolution.
       */
-    double m_delayLine[MAX_NUMBER_OF_CONTROLS * 2];
+    double m_history[FILTER_SPREAD * 2 + DSPKernels::MAX_BLOCK_SIZE];
+
+    /** Block size the kernel table has been picked for. */
+    int m_blockSize;
+
+    /** Kernels specialized for the current block size. */
+    const DSPKernels::KernelTable *m_kernels;
 
     /** State of the equalizer controls. */
     double m_controls[MAX_NUMBER_OF_CONTROLS];
 
+    /** Controls locked against the automatic adaption. */
+    bool m_locked[MAX_NUMBER_OF_CONTROLS];
+
+    /** Filter coefficients loaded from a preset, and the controls version
+      * they belong to. */
+    double m_presetCoefficients[FILTER_SPREAD * 2 + 1];
+    int m_presetVersion;
+
+    /** Edits queued by the GUI. */
+    jack_ringbuffer_t *m_editRingBuffer;
+
+    /** Default time to crossfade between filters in milliseconds. */
+    static const int DEFAULT_CROSSFADE_TIME = 20;
+
+    /** Semaphore serializing building and selecting filters of the bank. */
+    QSemaphore *m_bankAccessSemaphore;
+
+    /** Precomputed filters. */
+    double m_bankCoefficients[BANK_SIZE][FILTER_SPREAD * 2 + 1];
+    bool m_bankReady[BANK_SIZE];
+
+    /** Filter selected by the GUI. Stored with release semantics, so that
+      * the coefficients built before are visible to the audio thread. */
+    QAtomicInt m_selectedBank;
+
+    /** Filter the audio thread is playing, published for the builders once
+      * it has stopped reading the previous one. */
+    QAtomicInt m_playingBank;
+
+    /** Memory to design the filters of the bank, along with its plan. */
+    fftw_complex *m_bankIdealFilter;
+    fftw_complex *m_bankImpulseResponse;
+    fftw_plan m_bankPlan;
+
+    /** Crossfade time in milliseconds. */
+    QAtomicInt m_crossfadeTime;
+
+    /** Filter faded out, with its own convolution history and output. */
+    double m_fadeCoefficients[FILTER_SPREAD * 2 + 1];
+    double m_fadeHistory[FILTER_SPREAD * 2 + DSPKernels::MAX_BLOCK_SIZE];
+    jack_default_audio_sample_t m_fadeOutput[DSPKernels::MAX_BLOCK_SIZE];
+
+    /** Length of the crossfade and samples left of it. */
+    int m_crossfadeLength;
+    int m_crossfadeRemaining;
+
     /** Memory to compute filter coefficients. Allocated once to avoid
       * memory reallocation, which is pretty expensive. */
-    fftw_complex m_idealFilter[MAX_NUMBER_OF_CONTROLS * 2];
+    fftw_complex m_idealFilter[FILTER_RESOLUTION * 2];
 
     /** Memory to compute filter coefficients. Allocated once to avoid
       * memory reallocation, which is pretty expensive. */
-    fftw_complex m_ifftIdealFilter[MAX_NUMBER_OF_CONTROLS * 2];
+    fftw_complex m_ifftIdealFilter[FILTER_RESOLUTION * 2];
+
+    /** Plan of the inverse FFT of the ideal filter, created once as
+      * planning is neither cheap nor safe on the audio thread. */
+    fftw_plan m_inversePlan;
 };
 
 #endif // EQUALIZER_H
@@ -31,10 +31,12 @@
 EqualizerWidget::EqualizerWidget(Equalizer *equalizer, int controls, int maxFrequency, QWidget *parent) :
     QWidget(parent),
     _equalizer(equalizer),
+    _controlSmoother(ControlGrid::MAX_BANDS),
     _controls(controls),
     _maxFrequency(maxFrequency) {
 
     createSliders();
+    _shownSnapshotVersion = -1;
 
     _pollingTimer = new QTimer();
     _pollingTimer->setInterval(50);
@@ -42,17 +44,47 @@ EqualizerWidget::EqualizerWidget(Equalizer *equalizer, int controls, int maxFreq
 
     connect(_pollingTimer, SIGNAL(timeout()), this, SLOT(poll()));
     _pollingTimer->start();
+
+    // Dragging a slider changes its value for every pixel, so the edits
+    // are collected and handed over in batches.
+    _editTimer = new QTimer(this);
+    _editTimer->setInterval(EDIT_INTERVAL);
+    _editTimer->setSingleShot(true);
+    connect(_editTimer, SIGNAL(timeout()), this, SLOT(flushEdits()));
 }
 
 void EqualizerWidget::sliderMoved(int value) {
     QSlider *slider = dynamic_cast<QSlider*>(sender());
     if(slider) {
-        //qDebug() << value << " for " << _sliders[_sliderIndices[slider]].controlFrequency;
-
+        _pendingEdits.insert(_sliderIndices[slider], value);
+        if(!_editTimer->isActive())
+            _editTimer->start();
     }
     update();
 }
 
+void EqualizerWidget::flushEdits() {
+    // A slider moves the controls up to the neighboring sliders.
+    double sliderDistance = 2.5 * log2(10.0) / _controls;
+
+    QMap<int, int>::iterator edit = _pendingEdits.begin();
+    while(edit != _pendingEdits.end()) {
+        const FrequencySlider &fs = _sliders.at(edit.key());
+        double value = (double)edit.value() / fs.slider->maximum();
+        if(!_equalizer->editControls(fs.controlFrequency, qMax(0.01, value), sliderDistance)) {
+            // The audio thread has not caught up yet, try again later.
+            _editTimer->start();
+            return;
+        }
+        edit = _pendingEdits.erase(edit);
+    }
+}
+
+void EqualizerWidget::mouseDoubleClickEvent(QMouseEvent *mouseEvent) {
+    _equalizer->unlockControls();
+    QWidget::mouseDoubleClickEvent(mouseEvent);
+}
+
 void EqualizerWidget::createSliders() {
     QGridLayout *layout = new QGridLayout();
     for(int i = 0; i <= _controls; i++) {
@@ -98,29 +130,55 @@ void EqualizerWidget::createSliders() {
 }
 
 void EqualizerWidget::poll() {
-    double *c = _equalizer->controls();
-    int numControls = _equalizer->numberOfControls();
-
-    int eqStartRangeIndex = 0;
-    int eqEndRangeIndex = 0;
-    _equalizer->acquireControls();
-
-    foreach(FrequencySlider fs, _sliders) {
-        eqEndRangeIndex = fs.controlFrequency * numControls / _maxFrequency;
-
-        double accSliderValues = 0.0;
-        for(int i = eqStartRangeIndex; i < eqEndRangeIndex; i++) {
-            accSliderValues += c[i];
-        }
+    _pollingTimer->start();
 
-        double avgSliderValue = accSliderValues / (double)(eqEndRangeIndex - eqStartRangeIndex);
-        fs.slider->setValue(avgSliderValue * fs.slider->maximum());
-        eqStartRangeIndex = eqEndRangeIndex;
+    // Nothing to do while nobody can see the sliders, or if the filter has
+    // not been redesigned since the last time.
+    if(!isVisible() || visibleRegion().isEmpty())
+        return;
+    int snapshotVersion = _equalizer->snapshotVersion();
+    if(snapshotVersion == _shownSnapshotVersion)
+        return;
+    _shownSnapshotVersion = snapshotVersion;
+
+    // Read the controls without blocking the audio thread.
+    _equalizer->readSnapshot(&_snapshot);
+    if(_snapshot.m_bandsPerOctave != _controlGrid.bandsPerOctave()
+    || _snapshot.m_sampleRate != _controlGrid.sampleRate())
+        _controlGrid.setup(_snapshot.m_bandsPerOctave, _snapshot.m_sampleRate);
+    if(_snapshot.m_numberOfControls != _controlGrid.bands())
+        return;
+
+    // The controls sit on fractional octave bands, which are usually
+    // denser than the sliders. Average them over the distance between two
+    // sliders and read them out at the frequency of each slider.
+    double sliderFraction = _controls / (2.5 * log2(10.0));
+    _controlSmoother.setupLogarithmic(_controlGrid.bands(), _controlGrid.bandsPerOctave(),
+                                      sliderFraction);
+    _controlSmoother.smooth(_snapshot.m_controls, _smoothedControls);
+
+    // Move all sliders first and repaint the curve once afterwards, instead
+    // of once for every slider.
+    bool changed = false;
+    for(int i = 0; i < _sliders.count(); i++) {
+        // Do not move sliders away from under the mouse.
+        const FrequencySlider &fs = _sliders.at(i);
+        if(fs.slider->isSliderDown() || _pendingEdits.contains(i))
+            continue;
+
+        double sliderValue = _controlGrid.interpolate(_smoothedControls, fs.controlFrequency);
+        int value = sliderValue * fs.slider->maximum();
+        if(value == fs.slider->value())
+            continue;
+
+        fs.slider->blockSignals(true);
+        fs.slider->setValue(value);
+        fs.slider->blockSignals(false);
+        changed = true;
     }
 
-    _equalizer->releaseControls();
-
-    _pollingTimer->start();
+    if(changed)
+        update();
 }
 
 void EqualizerWidget::paintEvent(QPaintEvent *paintEvent) {
@@ -8,9 +8,11 @@
 #include <QMap>
 
 #include <QPaintEvent>
+#include <QMouseEvent>
 #include <QTimer>
 
 #include "equalizer.h"
+#include "spectralsmoother.h"
 
 class EqualizerWidget : public QWidget {
     Q_OBJECT
@@ -25,9 +27,16 @@ public slots:
 protected:
     void paintEvent(QPaintEvent *paintEvent);
 
+    /** Unlocks all controls edited by hand. */
+    void mouseDoubleClickEvent(QMouseEvent *mouseEvent);
+
 private slots:
     void poll();
 
+    /** Hands the slider values changed since the last time over to the
+      * equalizer. */
+    void flushEdits();
+
 private:
     void createSliders();
 
@@ -43,6 +52,24 @@ private:
 
     QTimer *_pollingTimer;
 
+    /** Minimum time between two batches of edits in milliseconds. */
+    static const int EDIT_INTERVAL = 20;
+
+    /** Slider values not handed over to the equalizer yet, by slider. */
+    QMap<int, int> _pendingEdits;
+    QTimer *_editTimer;
+
+    /** Last snapshot of the controls and the version shown by the sliders. */
+    Equalizer::ControlsSnapshot _snapshot;
+    int _shownSnapshotVersion;
+
+    /** Grid of the snapshot. */
+    ControlGrid _controlGrid;
+
+    /** Smooths the controls over the distance between two sliders. */
+    SpectralSmoother _controlSmoother;
+    double _smoothedControls[ControlGrid::MAX_BANDS];
+
     int _controls;
     int _maxFrequency;
 };
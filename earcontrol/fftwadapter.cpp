@@ -20,6 +20,12 @@
 
 // FFTW3 includes:
 #include "fftwadapter.h"
+#include "semaphorelocker.h"
+
+QSemaphore *FFTWAdapter::plannerSemaphore() {
+    static QSemaphore semaphore(1);
+    return &semaphore;
+}
 
 void FFTWAdapter::blit(fftw_complex *fftw_complexIn,
                        jack_default_audio_sample_t *jack_default_audio_sample_tsOut,
@@ -56,17 +62,54 @@ void FFTWAdapter::blit(fftw_complex *fftw_complexIn,
 }
 
 void FFTWAdapter::performFFT(fftw_complex *input, fftw_complex *result, int n) {
+    SemaphoreLocker locker(plannerSemaphore());
+    Q_UNUSED(locker);
+
     fftw_plan plan = fftw_plan_dft_1d(n, input, result,
                                       FFTW_FORWARD, FFTW_ESTIMATE);
     fftw_execute(plan);
     fftw_destroy_plan(plan);
 }
 
+fftw_plan FFTWAdapter::planBatchedFFT(fftw_complex *input, fftw_complex *result,
+                                      int distance, int n, int howmany) {
+    SemaphoreLocker locker(plannerSemaphore());
+    Q_UNUSED(locker);
+
+    return fftw_plan_many_dft(1, &n, howmany,
+                              input, 0, 1, distance,
+                              result, 0, 1, distance,
+                              FFTW_FORWARD, FFTW_ESTIMATE);
+}
+
+void FFTWAdapter::separateSpectra(const fftw_complex *packed,
+                                  fftw_complex *first,
+                                  fftw_complex *second,
+                                  int n) {
+    // With z = x + iy and Z = X + iY, the spectra of the real signals x and
+    // y are X[k] = (Z[k] + Z*[n - k]) / 2 and Y[k] = (Z[k] - Z*[n - k]) / 2i.
+    for(int k = 0; k <= n / 2; k++) {
+        int mirrored = (n - k) % n;
+        double re = packed[k][0], im = packed[k][1];
+        double mirroredRe = packed[mirrored][0], mirroredIm = packed[mirrored][1];
+
+        first[k][0] = 0.5 * (re + mirroredRe);
+        first[k][1] = 0.5 * (im - mirroredIm);
+        second[k][0] = 0.5 * (im + mirroredIm);
+        second[k][1] = 0.5 * (mirroredRe - re);
+    }
+}
+
 void FFTWAdapter::performInverseFFT(fftw_complex *input, fftw_complex *result, int n) {
-    fftw_plan plan = fftw_plan_dft_1d(n, input, result,
-                                      FFTW_BACKWARD, FFTW_ESTIMATE);
-    fftw_execute(plan);
-    fftw_destroy_plan(plan);
+    {
+        SemaphoreLocker locker(plannerSemaphore());
+        Q_UNUSED(locker);
+
+        fftw_plan plan = fftw_plan_dft_1d(n, input, result,
+                                          FFTW_BACKWARD, FFTW_ESTIMATE);
+        fftw_execute(plan);
+        fftw_destroy_plan(plan);
+    }
 
     for(int i = 0; i < n; i++) {
         result[i][0] /= (double)n;
@@ -27,7 +27,17 @@
 // FFTW3 includes:
 #include "fftw3.h"
 
+// Qt includes:
+#include <QSemaphore>
+
 namespace FFTWAdapter {
+  /**
+    * Apart from fftw_execute, no FFTW routine is thread-safe. Every thread
+    * that creates or destroys plans has to hold this semaphore meanwhile.
+    * @return The semaphore serializing the FFTW planner.
+    */
+  QSemaphore *plannerSemaphore();
+
   /**
     * fftw works with arrays of fftw_complex numbers. In order to use fftw,
     * you have to convert between JACK samples, which are mere real numbers
@@ -60,6 +70,34 @@ namespace FFTWAdapter {
     */
   void performFFT(fftw_complex *input, fftw_complex *result, int n);
 
+  /**
+    * Plans a batch of ffts of the same size, that can be executed at once
+    * with fftw_execute. The input of transform k starts at
+    * input + k * distance, its result starts at result + k * distance.
+    * @param input Input array of howmany * distance fftw_complex numbers.
+    * @param result Output array of howmany * distance fftw_complex numbers.
+    * @param distance Distance between two transforms, at least n.
+    * @param n Number of samples per transform.
+    * @param howmany Number of transforms.
+    * @return The plan, to be destroyed with fftw_destroy_plan.
+    */
+  fftw_plan planBatchedFFT(fftw_complex *input, fftw_complex *result,
+                           int distance, int n, int howmany);
+
+  /**
+    * Separates the spectrum of two real signals that have been transformed
+    * together, the first signal in the real and the second signal in the
+    * imaginary part. Uses the conjugate symmetry of real signal spectra.
+    * @param packed Spectrum of the packed signals, n fftw_complex numbers.
+    * @param first Receives n / 2 + 1 bins of the first spectrum.
+    * @param second Receives n / 2 + 1 bins of the second spectrum.
+    * @param n Number of samples.
+    */
+  void separateSpectra(const fftw_complex *packed,
+                       fftw_complex *first,
+                       fftw_complex *second,
+                       int n);
+
   /**
     * Performs the inverse fft.
     * @param fftw_complex Input array of comples numbers.
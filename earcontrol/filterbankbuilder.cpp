@@ -0,0 +1,43 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "filterbankbuilder.h"
+
+#include <QDebug>
+
+FilterBankBuilder::FilterBankBuilder(Equalizer *equalizer, int bank, int bandsPerOctave,
+                                     int sampleRate, const double *controls, int numberOfControls)
+    : QRunnable() {
+    _equalizer = equalizer;
+    _bank = bank;
+    _bandsPerOctave = bandsPerOctave;
+    _sampleRate = sampleRate;
+    _controls.resize(numberOfControls);
+    for(int i = 0; i < numberOfControls; i++)
+        _controls[i] = controls[i];
+    setAutoDelete(true);
+}
+
+void FilterBankBuilder::run() {
+    if(!_equalizer->buildBank(_bank, _bandsPerOctave, _sampleRate,
+                              _controls.constData(), _controls.count())) {
+        qDebug() << "Could not build filter bank" << _bank + 1;
+    }
+}
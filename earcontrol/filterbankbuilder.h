@@ -0,0 +1,66 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FILTERBANKBUILDER_H
+#define FILTERBANKBUILDER_H
+
+#include <QRunnable>
+#include <QVector>
+
+#include "equalizer.h"
+
+/**
+ * @class FilterBankBuilder
+ *
+ * @author Jacob Dawid ( jacob@omg-it.works )
+ * @author Otto Ritter ( otto.ritter.or@googlemail.com )
+ * @date 09.2011-2016
+ *
+ * @brief Designs a filter of the equalizer bank on a pool thread.
+ *
+ * Takes a copy of the controls, so the source of the controls may be gone
+ * by the time the job runs. Deletes itself when done.
+ */
+class FilterBankBuilder : public QRunnable {
+public:
+    /**
+      * Constructs a new job.
+      * @param equalizer Equalizer the filter is stored in.
+      * @param bank Index of the filter in the bank.
+      * @param bandsPerOctave Resolution of the controls.
+      * @param sampleRate Sample rate the controls have been saved at.
+      * @param controls Controls to design the filter from.
+      * @param numberOfControls Number of controls.
+      */
+    FilterBankBuilder(Equalizer *equalizer, int bank, int bandsPerOctave, int sampleRate,
+                      const double *controls, int numberOfControls);
+
+    /** Reimplemented from QRunnable. */
+    void run();
+
+private:
+    Equalizer *_equalizer;
+    int _bank;
+    int _bandsPerOctave;
+    int _sampleRate;
+    QVector<double> _controls;
+};
+
+#endif // FILTERBANKBUILDER_H
@@ -0,0 +1,108 @@
+/*
+    Copyright (C) 2011-2016 Jacob Dawid <jacob@omg-it.works>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include "blockrandomgenerator.h"
+#include "randomgenerator.h"
+
+BlockRandomGenerator::BlockRandomGenerator() {
+    init(0);
+}
+
+void BlockRandomGenerator::init(uint32_t seed, int substream) {
+    // The lagged Fibonacci generator provides a well mixed base state. The
+    // state must not be all zero.
+    RandomGenerator seeder;
+    seeder.init(seed);
+    uint32_t s[4];
+    do {
+        for(int k = 0; k < 4; k++)
+            s[k] = seeder.irand();
+    } while((s[0] | s[1] | s[2] | s[3]) == 0);
+
+    // Every lane of every substream starts at its own multiple of 2^64
+    // steps from the base state.
+    for(int j = 0; j < substream * LANES; j++)
+        jump(s);
+
+    for(int l = 0; l < LANES; l++) {
+        m_s0[l] = s[0];
+        m_s1[l] = s[1];
+        m_s2[l] = s[2];
+        m_s3[l] = s[3];
+        jump(s);
+    }
+}
+
+void BlockRandomGenerator::jump(uint32_t *s) {
+    static const uint32_t polynomial[4] = {
+        0x8764000b, 0xf542d2d3, 0x6fa035c3, 0x77f2db5b
+    };
+
+    uint32_t t[4] = { 0, 0, 0, 0 };
+    for(int i = 0; i < 4; i++) {
+        for(int b = 0; b < 32; b++) {
+            if(polynomial[i] & (1u << b)) {
+                for(int k = 0; k < 4; k++)
+                    t[k] ^= s[k];
+            }
+
+            uint32_t u = s[1] << 9;
+            s[2] ^= s[0];
+            s[3] ^= s[1];
+            s[1] ^= s[2];
+            s[0] ^= s[3];
+            s[2] ^= u;
+            s[3] = (s[3] << 11) | (s[3] >> 21);
+        }
+    }
+
+    for(int k = 0; k < 4; k++)
+        s[k] = t[k];
+}
+
+void BlockRandomGenerator::generate(uint32_t *out, int n) {
+    uint32_t s0[LANES], s1[LANES], s2[LANES], s3[LANES];
+    for(int l = 0; l < LANES; l++) {
+        s0[l] = m_s0[l];
+        s1[l] = m_s1[l];
+        s2[l] = m_s2[l];
+        s3[l] = m_s3[l];
+    }
+
+    for(int i = 0; i < n; i += LANES) {
+        for(int l = 0; l < LANES; l++) {
+            uint32_t sum = s0[l] + s3[l];
+            out[i + l] = ((sum << 7) | (sum >> 25)) + s0[l];
+
+            uint32_t t = s1[l] << 9;
+            s2[l] ^= s0[l];
+            s3[l] ^= s1[l];
+            s1[l] ^= s2[l];
+            s0[l] ^= s3[l];
+            s2[l] ^= t;
+            s3[l] = (s3[l] << 11) | (s3[l] >> 21);
+        }
+    }
+
+    for(int l = 0; l < LANES; l++) {
+        m_s0[l] = s0[l];
+        m_s1[l] = s1[l];
+        m_s2[l] = s2[l];
+        m_s3[l] = s3[l];
+    }
+}
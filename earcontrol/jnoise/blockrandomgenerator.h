@@ -0,0 +1,64 @@
+/*
+    Copyright (C) 2011-2016 Jacob Dawid <jacob@omg-it.works>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef BLOCK_RANDOM_GENERATOR_H
+#define BLOCK_RANDOM_GENERATOR_H
+
+#include <stdint.h>
+
+/**
+ * Generates uniformly distributed random numbers in blocks. Runs LANES
+ * independent xoshiro128++ generators side by side, whose states are kept
+ * in separate arrays per state word. Every step advances all lanes with the
+ * same operations, so the compiler is able to vectorize the lane loop.
+ */
+class BlockRandomGenerator {
+public:
+    /** Number of independent generators. Blocks are multiples of this. */
+    static const int LANES = 8;
+
+    BlockRandomGenerator();
+
+    /**
+      * Seeds all lanes. Every seed provides a family of substreams, which
+      * are 2^64 numbers apart per lane and therefore never overlap, so
+      * generators seeded with the same seed and different substreams are
+      * independent of each other.
+      * @param seed Seed, zero seeds from the current time.
+      * @param substream Index of the substream.
+      */
+    void init(uint32_t seed, int substream = 0);
+
+    /**
+      * Generates random numbers.
+      * @param out Receives n random numbers.
+      * @param n Number of random numbers, a multiple of LANES.
+      */
+    void generate(uint32_t *out, int n);
+
+private:
+    /** Advances a single xoshiro128++ state by 2^64 steps. */
+    static void jump(uint32_t *s);
+
+    uint32_t m_s0[LANES];
+    uint32_t m_s1[LANES];
+    uint32_t m_s2[LANES];
+    uint32_t m_s3[LANES];
+};
+
+#endif // BLOCK_RANDOM_GENERATOR_H
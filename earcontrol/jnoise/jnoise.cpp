@@ -19,52 +19,102 @@
 
 #include "jnoise.h"
 
+#include <string.h>
+
 JNoise::JNoise() {
-    int i;
-    m_randomGenerator.init(0);
-    float s = 0.0f;
-    for(i = 0; i < LRAND; i++) {
-        s += m_frand[i] = 0.5f * m_randomGenerator.grandf();
-    }
+    // Pink noise filter after Paul Kellett, the last two poles are unused.
+    static const float poles[PINK_POLES] = {
+        0.99886f, 0.99332f, 0.96900f, 0.86650f, 0.55000f, -0.7616f, 0.0f, 0.0f
+    };
+    static const float gains[PINK_POLES] = {
+        0.0555179f, 0.0750759f, 0.1538520f, 0.3104856f, 0.5329522f, -0.0168980f, 0.0f, 0.0f
+    };
 
-    s /= LRAND;
-    for (i = 0; i < LRAND; i++) {
-        m_frand [i] -= s;
+    for(int i = 0; i < PINK_POLES; i++) {
+        m_pole[i] = poles[i];
+        m_gain[i] = gains[i];
+        m_state[i] = 0.0f;
     }
+    m_previous = 0.0f;
+}
 
-    for(i = 0; i < 7; i++) {
-        m_coeff[i] = 0.0f;
-    }
+void JNoise::seed(uint32_t seed, int substream) {
+    m_randomGenerator.init(seed, substream);
+
+    // The rare slow path of the ziggurat takes its numbers from the same
+    // substream, so the whole noise is reproducible.
+    uint32_t first[BlockRandomGenerator::LANES];
+    m_randomGenerator.generate(first, BlockRandomGenerator::LANES);
+    m_gaussianGenerator.init(first[0] | 1);
+
+    for(int i = 0; i < PINK_POLES; i++)
+        m_state[i] = 0.0f;
+    m_previous = 0.0f;
 }
 
 void JNoise::process(int n, float *whiteNoiseBufferLeft, float *whiteNoiseBufferRight,
                             float *pinkNoiseBufferLeft, float *pinkNoiseBufferRight) {
-    float x;
-    while (n--) {
-        x  = m_frand[m_randomGenerator.irand () & MRAND]
-           + m_frand[m_randomGenerator.irand () & MRAND]
-           + m_frand[m_randomGenerator.irand () & MRAND]
-           + m_frand[m_randomGenerator.irand () & MRAND];
-
-        float whiteNoiseValue = 0.1f * x;
-        if(whiteNoiseBufferLeft)
-            *whiteNoiseBufferLeft++ = whiteNoiseValue;
-        if(whiteNoiseBufferRight)
-            *whiteNoiseBufferRight++ = whiteNoiseValue;
-
-        x *= 0.03f;
-        m_coeff[0] = 0.99886f * m_coeff[0] + 0.0555179f * x;
-        m_coeff[1] = 0.99332f * m_coeff[1] + 0.0750759f * x;
-        m_coeff[2] = 0.96900f * m_coeff[2] + 0.1538520f * x;
-        m_coeff[3] = 0.86650f * m_coeff[3] + 0.3104856f * x;
-        m_coeff[4] = 0.55000f * m_coeff[4] + 0.5329522f * x;
-        m_coeff[5] = -0.7616f * m_coeff[5] - 0.0168980f * x;
-
-        float pinkNoiseValue = m_coeff[0] + m_coeff[1] + m_coeff[2] + m_coeff[3] + m_coeff[4] + m_coeff[5] + m_coeff[6] + x * 0.5362f;
-        if(pinkNoiseBufferLeft)
-            *pinkNoiseBufferLeft++ = pinkNoiseValue;
-        if(pinkNoiseBufferRight)
-            *pinkNoiseBufferRight++ = pinkNoiseValue;
-        m_coeff[6] = x * 0.115926f;
+    // Decide on the outputs once per call instead of once per sample.
+    if(whiteNoiseBufferLeft || whiteNoiseBufferRight) {
+        float *white = whiteNoiseBufferLeft ? whiteNoiseBufferLeft : whiteNoiseBufferRight;
+        processWhite(n, white);
+        if(whiteNoiseBufferLeft && whiteNoiseBufferRight)
+            memcpy(whiteNoiseBufferRight, white, n * sizeof(float));
     }
+
+    if(pinkNoiseBufferLeft || pinkNoiseBufferRight) {
+        float *pink = pinkNoiseBufferLeft ? pinkNoiseBufferLeft : pinkNoiseBufferRight;
+        processPink(n, pink);
+        if(pinkNoiseBufferLeft && pinkNoiseBufferRight)
+            memcpy(pinkNoiseBufferRight, pink, n * sizeof(float));
+    }
+}
+
+void JNoise::processWhite(int n, float *whiteNoiseBuffer) {
+    generate(n, whiteNoiseBuffer);
+    for(int i = 0; i < n; i++)
+        whiteNoiseBuffer[i] *= 0.1f;
+}
+
+void JNoise::processPink(int n, float *pinkNoiseBuffer) {
+    generate(n, pinkNoiseBuffer);
+    shapePink(n, pinkNoiseBuffer);
+}
+
+void JNoise::generate(int n, float *out) {
+    // A sample takes a single random number in the common path.
+    while(n > 0) {
+        int count = n < BLOCK_SIZE ? n : BLOCK_SIZE;
+        int numbers = (count + BlockRandomGenerator::LANES - 1)
+                    & ~(BlockRandomGenerator::LANES - 1);
+        m_randomGenerator.generate(m_random, numbers);
+        m_gaussianGenerator.zigguratf(m_random, out, count);
+
+        out += count;
+        n -= count;
+    }
+}
+
+void JNoise::shapePink(int n, float *buffer) {
+    // The poles are independent of each other, so they are updated
+    // together for every sample as lanes of a vector.
+    float state[PINK_POLES];
+    for(int k = 0; k < PINK_POLES; k++)
+        state[k] = m_state[k];
+    float previous = m_previous;
+
+    for(int i = 0; i < n; i++) {
+        float x = 0.03f * buffer[i];
+        float sum = 0.0f;
+        for(int k = 0; k < PINK_POLES; k++) {
+            state[k] = m_pole[k] * state[k] + m_gain[k] * x;
+            sum += state[k];
+        }
+        buffer[i] = sum + previous + x * 0.5362f;
+        previous = x * 0.115926f;
+    }
+
+    for(int k = 0; k < PINK_POLES; k++)
+        m_state[k] = state[k];
+    m_previous = previous;
 }
@@ -23,21 +23,62 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
+#include "blockrandomgenerator.h"
 #include "randomgenerator.h"
 
-#define LRAND 1024
-#define MRAND (LRAND - 1)
-
+/**
+ * Generates white and pink noise in blocks. The white noise is normally
+ * distributed, transformed from the uniform random numbers of the block
+ * generator with the ziggurat method. The pink noise is shaped by a bank of one-pole filters,
+ * which run side by side as lanes of a small vector.
+ */
 class JNoise {
 public:
     JNoise();
+
+    /**
+      * Restarts the noise on a substream of a seed. Noise generators seeded
+      * with the same seed and different substreams are independent of each
+      * other, while the same seed and substream always yield the same noise.
+      * @param seed Seed, zero seeds from the current time.
+      * @param substream Index of the substream.
+      */
+    void seed(uint32_t seed, int substream);
+
+    /** Fills any of the given buffers, which may be null, with n samples. */
     void process(int n, float *whiteNoiseBufferLeft, float *whiteNoiseBufferRight,
                  float *pinkNoiseBufferLeft, float *pinkNoiseBufferRight);
 
+    /** Writes n samples of white noise. */
+    void processWhite(int n, float *whiteNoiseBuffer);
+
+    /** Writes n samples of pink noise. */
+    void processPink(int n, float *pinkNoiseBuffer);
+
 private:
-    float m_frand[LRAND];
-    RandomGenerator m_randomGenerator;
-    float m_coeff[7];
+    /** Number of samples generated at once. */
+    static const int BLOCK_SIZE = 256;
+
+    /** Number of one-pole filters shaping the pink noise, padded to a
+      * multiple of the vector width. */
+    static const int PINK_POLES = 8;
+
+    /** Generates unscaled noise with unit variance. */
+    void generate(int n, float *out);
+
+    /** Filters unscaled noise into pink noise in place. */
+    void shapePink(int n, float *buffer);
+
+    BlockRandomGenerator m_randomGenerator;
+    uint32_t m_random[BLOCK_SIZE];
+
+    /** Resolves the few samples outside of the common path of the ziggurat. */
+    RandomGenerator m_gaussianGenerator;
+
+    float m_pole[PINK_POLES];
+    float m_gain[PINK_POLES];
+    float m_state[PINK_POLES];
+    float m_previous;
 };
 
 #endif // JNOISE_H
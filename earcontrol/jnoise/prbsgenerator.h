@@ -96,6 +96,31 @@
 //    the first form when the output is taken from the shifted out bit.
 //
 //
+//  step8 ()
+//
+//     Returns the next 8 bits at once, the LSB being the first one. The
+//     shift register is linear, so the 8 steps only depend on the lowest 8
+//     bits of the state and are looked up in tables built by set_poly ().
+//
+//
+//  jump (n)
+//
+//     Advances the generator by n bits. Far jumps raise the transition
+//     matrix of a step to the power of n over GF (2) by repeated squaring,
+//     which takes O (log n) matrix products.
+//
+//
+//  bits (p, n)
+//
+//     Writes the next n bytes of packed bits, the LSB being the first one.
+//
+//
+//  sequence (p, n)
+//
+//     Writes the next n bits as a sequence of floats, -1 for a one and +1
+//     for a zero, as used for maximum length sequence measurements.
+//
+//
 //---------------------------------------------------------------------------==
 
 
@@ -111,6 +136,10 @@ public:
         G8  = 0x0000008E,
         G15 = 0x00004001,
         G16 = 0x00008016,
+        G17 = 0x00010004,
+        G18 = 0x00020040,
+        G19 = 0x00040013,
+        G20 = 0x00080004,
         G23 = 0x00400010,
         G24 = 0x0080000D,
         G31 = 0x40000004,
@@ -124,6 +153,10 @@ public:
     void sync_forw (uint32_t bits);
     void sync_back (uint32_t bits);
     int  step (void);
+    int  step8 (void);
+    void jump (uint64_t n);
+    void bits (uint8_t *p, int n);
+    void sequence (float *p, int n);
     void crc_in (int b);
     int  crc_out (void);
 
@@ -137,12 +170,16 @@ public:
 
 private:
 
+    static uint32_t apply (const uint32_t *m, uint32_t v);
+
     uint32_t _stat;
     uint32_t _poly;
     uint32_t _mask;
     uint32_t _hbit;
     int _degr;
 
+    uint32_t _next [256];  // State after 8 steps, given the lowest 8 bits.
+    uint8_t  _bits [256];  // Bits output by these 8 steps.
 };
 
 
@@ -172,6 +209,22 @@ inline void PRBSGenerator::setPoly (uint32_t poly)
     }
     _stat = _mask;
     _hbit = (_mask >> 1) + 1;
+
+    for (int b = 0; b < 256; b++)
+    {
+        uint32_t s = b;
+        int      k = 0;
+
+        for (int i = 0; i < 8; i++)
+        {
+            int bit = s & 1;
+            s >>= 1;
+            if (bit) s ^= _poly;
+            k |= bit << i;
+        }
+        _next [b] = s;
+        _bits [b] = k;
+    }
 }
 
 
@@ -199,6 +252,78 @@ inline int PRBSGenerator::step (void)
 }
 
 
+inline int PRBSGenerator::step8 (void)
+{
+    int b;
+
+    assert (_poly != 0);
+
+    b = _stat & 255;
+    _stat = (_stat >> 8) ^ _next [b];
+
+    return _bits [b];
+}
+
+
+inline uint32_t PRBSGenerator::apply (const uint32_t *m, uint32_t v)
+{
+    uint32_t r = 0;
+
+    for (int i = 0; v; i++, v >>= 1)
+    {
+        if (v & 1) r ^= m [i];
+    }
+    return r;
+}
+
+
+inline void PRBSGenerator::jump (uint64_t n)
+{
+    uint32_t p [32], q [32];
+
+    assert (_poly != 0);
+
+    // Near jumps are cheaper byte by byte.
+    if (n < 2048)
+    {
+        for (; n >= 8; n -= 8) step8 ();
+        for (; n; n--) step ();
+        return;
+    }
+
+    // Column j of the matrix is the state one step after state 1 << j.
+    for (int j = 0; j < _degr; j++) p [j] = j ? (1u << (j - 1)) : _poly;
+
+    while (n)
+    {
+        if (n & 1) _stat = apply (p, _stat);
+        n >>= 1;
+        if (n)
+        {
+            for (int j = 0; j < _degr; j++) q [j] = apply (p, p [j]);
+            for (int j = 0; j < _degr; j++) p [j] = q [j];
+        }
+    }
+}
+
+
+inline void PRBSGenerator::bits (uint8_t *p, int n)
+{
+    while (n--) *p++ = step8 ();
+}
+
+
+inline void PRBSGenerator::sequence (float *p, int n)
+{
+    for (; n >= 8; n -= 8)
+    {
+        int b = step8 ();
+        for (int i = 0; i < 8; i++) *p++ = ((b >> i) & 1) ? -1.0f : 1.0f;
+    }
+    while (n--) *p++ = step () ? -1.0f : 1.0f;
+}
+
+
 inline void PRBSGenerator::sync_forw (uint32_t bits)
 {
     assert (_poly != 0);
@@ -55,99 +55,181 @@ void RandomGenerator::init (uint32_t s)
     {
         prbsGenerator.step ();
         j = prbsGenerator.stat () & 4095;
-        while (j--) prbsGenerator.step ();
+        prbsGenerator.jump (j);
         _a [i] = prbsGenerator.stat ();
     }
 
     _i = 0;
-    _md = false;
-    _mf = false;
 }
 
 
-double RandomGenerator::grand (void)
+// Ziggurat method after Marsaglia and Tsang. The normal density is covered
+// by 128 layers of equal area. A sample picks a layer and a position in it,
+// and is accepted right away if it lies within the part of the layer that
+// is completely below the density, which is the case in about 99% of all
+// samples. The layer is taken from the lowest 7 bits of a random number and
+// the position from the remaining bits, so the two are independent.
+
+struct ZigguratTables
 {
-    double a, b, r;
+    ZigguratTables (void);
+
+    uint32_t  k [128];  // Acceptance limits of the positions.
+    double    w [128];  // Scale from positions to samples.
+    float     wf [128];
+    double    f [128];  // Density at the upper edge of each layer.
+};
 
-    if (_md)
-    {
-	_md = false;
-	return _vd;
-    }
 
-    do
+static const double ZIGGURAT_R = 3.442619855899;
+static const double ZIGGURAT_V = 9.91256303526217e-3;
+
+
+ZigguratTables::ZigguratTables (void)
+{
+    const double m = 2147483648.0;
+    double d = ZIGGURAT_R, t = d;
+    double q = ZIGGURAT_V / exp (-0.5 * d * d);
+
+    k [0] = (uint32_t)((d / q) * m);
+    k [1] = 0;
+    w [0] = q / m;
+    w [127] = d / m;
+    f [0] = 1.0;
+    f [127] = exp (-0.5 * d * d);
+
+    for (int i = 126; i >= 1; i--)
     {
-	a = irand () / _p31 - 1.0;
-	b = irand () / _p31 - 1.0;
-	r = a * a + b * b;
+	d = sqrt (-2.0 * log (ZIGGURAT_V / d + exp (-0.5 * d * d)));
+	k [i + 1] = (uint32_t)((d / t) * m);
+	t = d;
+	f [i] = exp (-0.5 * d * d);
+	w [i] = d / m;
     }
-    while ((r > 1.0) || (r < 1e-20));
 
-    r = sqrt (-2.0 * log (r) / r);
-    _md = true;
-    _vd = r * b;
+    for (int i = 0; i < 128; i++) wf [i] = (float) w [i];
+}
 
-    return r * a;
-}    
 
+static const ZigguratTables zigguratTables;
 
-void RandomGenerator::grand (double *x, double *y)
+
+double RandomGenerator::ziggurat (uint32_t r)
 {
-    double a, b, r;
+    const ZigguratTables &z = zigguratTables;
+    int      iz = r & 127;
+    int32_t  hz = (int32_t)(r & ~127u);
+    double   x, y;
 
-    do
+    for (;;)
     {
-	a = irand () / _p31 - 1.0;
-	b = irand () / _p31 - 1.0;
-	r = a * a + b * b;
+	x = hz * z.w [iz];
+
+	// The base layer includes the tail beyond R.
+	if (iz == 0)
+	{
+	    do
+	    {
+		x = -log (1.0 - urand ()) / ZIGGURAT_R;
+		y = -log (1.0 - urand ());
+	    }
+	    while (y + y < x * x);
+	    return (hz > 0) ? ZIGGURAT_R + x : -ZIGGURAT_R - x;
+	}
+
+	// The wedge between the layer and the density.
+	if (z.f [iz] + urand () * (z.f [iz - 1] - z.f [iz]) < exp (-0.5 * x * x)) return x;
+
+	r = irand ();
+	iz = r & 127;
+	hz = (int32_t)(r & ~127u);
+	uint32_t a = hz < 0 ? 0u - (uint32_t) hz : (uint32_t) hz;
+	if (a < z.k [iz]) return hz * z.w [iz];
     }
-    while ((r > 1.0) || (r < 1e-20));
-
-    r = sqrt (-log (r) / r);
-    *x = r * a;
-    *y = r * b;
-}    
+}
 
 
-float RandomGenerator::grandf (void)
+double RandomGenerator::grand (void)
 {
-    float a, b, r;
+    const ZigguratTables &z = zigguratTables;
+    uint32_t r = irand ();
+    int      iz = r & 127;
+    int32_t  hz = (int32_t)(r & ~127u);
+    uint32_t a = hz < 0 ? 0u - (uint32_t) hz : (uint32_t) hz;
+
+    if (a < z.k [iz]) return hz * z.w [iz];
+    return ziggurat (r);
+}
 
-    if (_mf)
-    {
-	_mf = false;
-	return _vf;
-    }
 
-    do
-    {
-	a = irand () / _p31f - 1.0f;
-	b = irand () / _p31f - 1.0f;
-	r = a * a + b * b;
-    }
-    while ((r > 1.0f) || (r < 1e-20f));
+void RandomGenerator::grand (double *x, double *y)
+{
+    // Both have a variance of 1/2.
+    *x = M_SQRT1_2 * grand ();
+    *y = M_SQRT1_2 * grand ();
+}
 
-    r = sqrtf (-2.0f * logf (r) / r);
-    _mf = true;
-    _vf = r * b;
 
-    return r * a;
-}    
+float RandomGenerator::grandf (void)
+{
+    return (float) grand ();
+}
 
 
 void RandomGenerator::grandf (float *x, float *y)
 {
-    float a, b, r;
+    *x = (float)(M_SQRT1_2 * grand ());
+    *y = (float)(M_SQRT1_2 * grand ());
+}
+
+
+void RandomGenerator::zigguratf (const uint32_t *bits, float *out, int n)
+{
+    const ZigguratTables &z = zigguratTables;
+    int  rejected [256];
 
-    do
+    while (n > 0)
     {
-	a = irand () / _p31f - 1.0f;
-	b = irand () / _p31f - 1.0f;
-	r = a * a + b * b;
+	int m = (n < 256) ? n : 256;
+	int k = 0;
+
+	// The common path has no branches, the few rejected samples are
+	// only collected and resolved afterwards.
+	for (int i = 0; i < m; i++)
+	{
+	    uint32_t r = bits [i];
+	    int      iz = r & 127;
+	    int32_t  hz = (int32_t)(r & ~127u);
+	    uint32_t a = hz < 0 ? 0u - (uint32_t) hz : (uint32_t) hz;
+
+	    out [i] = hz * z.wf [iz];
+	    rejected [k] = i;
+	    k += (a >= z.k [iz]);
+	}
+
+	for (int j = 0; j < k; j++)
+	{
+	    int i = rejected [j];
+	    out [i] = (float) ziggurat (bits [i]);
+	}
+
+	bits += m;
+	out += m;
+	n -= m;
     }
-    while ((r > 1.0f) || (r < 1e-20f));
+}
 
-    r = sqrtf (-logf (r) / r);
-    *x = r * a;
-    *y = r * b;
-}    
+
+void RandomGenerator::fill_grandf (float *out, int n)
+{
+    uint32_t  bits [256];
+
+    while (n > 0)
+    {
+	int m = (n < 256) ? n : 256;
+	for (int i = 0; i < m; i++) bits [i] = irand ();
+	zigguratf (bits, out, m);
+	out += m;
+	n -= m;
+    }
+}
@@ -49,18 +49,25 @@ public:
     float   grandf (void);
     void    grandf (float  *x, float *y);
 
+    // Fills out with n normally distributed samples.
+    void    fill_grandf (float *out, int n);
+
+    // Transforms n uniformly distributed random numbers, which may come
+    // from any generator, into normally distributed samples. The rare
+    // samples needing more random numbers take them from this generator.
+    void    zigguratf (const uint32_t *bits, float *out, int n);
+
     ~RandomGenerator (void);
     RandomGenerator (const RandomGenerator&);           // disabled, not to be used
     RandomGenerator& operator=(const RandomGenerator&); // disabled, not to be used
 
 private:
 
+    // Resolves a sample outside of the common path of the ziggurat.
+    double  ziggurat (uint32_t r);
+
     uint32_t     _a [55];
     int     _i;
-    bool    _md;
-    bool    _mf;
-    double  _vd;
-    float   _vf;
 
     static const double _p31;
     static const double _p32;
@@ -0,0 +1,226 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "latencytracker.h"
+#include "fftwadapter.h"
+#include "semaphorelocker.h"
+
+#include <QDebug>
+
+#include <cmath>
+
+const double LatencyTracker::MINIMUM_PEAK_RATIO = 8.0;
+const double LatencyTracker::AVERAGING_WEIGHT = 0.5;
+
+LatencyTracker::LatencyTracker(int maximumLatency)
+    : QThread() {
+    _maximumLatency = maximumLatency < WINDOW_SIZE ? maximumLatency : WINDOW_SIZE - 1;
+
+    // Leave room for a few windows, so that the worker may lag behind.
+    size_t ringBufferSize = 4 * WINDOW_SIZE * sizeof(jack_default_audio_sample_t);
+    _referenceRingBuffer = jack_ringbuffer_create(ringBufferSize);
+    _measuredRingBuffer = jack_ringbuffer_create(ringBufferSize);
+    jack_ringbuffer_mlock(_referenceRingBuffer);
+    jack_ringbuffer_mlock(_measuredRingBuffer);
+
+    _latency.store(-1);
+    _resetRequested.store(false);
+    _candidate = -1;
+    _agreements = 0;
+
+    // Windows are zero padded to twice their size, so that the circular
+    // correlation equals the linear one for all lags we are looking at.
+    int n = 2 * WINDOW_SIZE;
+    _referenceWindow = (double*)fftw_malloc(sizeof(double) * n);
+    _measuredWindow = (double*)fftw_malloc(sizeof(double) * n);
+    _correlation = (double*)fftw_malloc(sizeof(double) * n);
+    _referenceSpectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * (n / 2 + 1));
+    _measuredSpectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * (n / 2 + 1));
+    _crossSpectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * (n / 2 + 1));
+    _inverseInput = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * (n / 2 + 1));
+    _crossSpectrumValid = false;
+
+    for(int i = 0; i < n; i++) {
+        _referenceWindow[i] = 0.0;
+        _measuredWindow[i] = 0.0;
+    }
+
+    // Plan here, the planner must not run concurrently with other threads.
+    SemaphoreLocker locker(FFTWAdapter::plannerSemaphore());
+    Q_UNUSED(locker);
+    _referencePlan = fftw_plan_dft_r2c_1d(n, _referenceWindow, _referenceSpectrum, FFTW_ESTIMATE);
+    _measuredPlan = fftw_plan_dft_r2c_1d(n, _measuredWindow, _measuredSpectrum, FFTW_ESTIMATE);
+    _correlationPlan = fftw_plan_dft_c2r_1d(n, _inverseInput, _correlation, FFTW_ESTIMATE);
+}
+
+LatencyTracker::~LatencyTracker() {
+    requestInterruption();
+    wait();
+
+    {
+        SemaphoreLocker locker(FFTWAdapter::plannerSemaphore());
+        Q_UNUSED(locker);
+        fftw_destroy_plan(_referencePlan);
+        fftw_destroy_plan(_measuredPlan);
+        fftw_destroy_plan(_correlationPlan);
+    }
+
+    fftw_free(_referenceWindow);
+    fftw_free(_measuredWindow);
+    fftw_free(_correlation);
+    fftw_free(_referenceSpectrum);
+    fftw_free(_measuredSpectrum);
+    fftw_free(_crossSpectrum);
+    fftw_free(_inverseInput);
+
+    jack_ringbuffer_free(_referenceRingBuffer);
+    jack_ringbuffer_free(_measuredRingBuffer);
+}
+
+void LatencyTracker::write(const jack_default_audio_sample_t *reference,
+                           const jack_default_audio_sample_t *measured,
+                           int samples) {
+    size_t size = samples * sizeof(jack_default_audio_sample_t);
+
+    // Both streams have to stay aligned, so either write both or none.
+    if(jack_ringbuffer_write_space(_referenceRingBuffer) < size
+    || jack_ringbuffer_write_space(_measuredRingBuffer) < size)
+        return;
+
+    jack_ringbuffer_write(_referenceRingBuffer, (const char*)reference, size);
+    jack_ringbuffer_write(_measuredRingBuffer, (const char*)measured, size);
+}
+
+int LatencyTracker::latency() {
+    return _latency.load();
+}
+
+void LatencyTracker::reset() {
+    _latency.store(-1);
+    _resetRequested.store(true);
+}
+
+void LatencyTracker::run() {
+    size_t windowBytes = WINDOW_SIZE * sizeof(jack_default_audio_sample_t);
+    jack_default_audio_sample_t *reference = new jack_default_audio_sample_t[WINDOW_SIZE];
+    jack_default_audio_sample_t *measured = new jack_default_audio_sample_t[WINDOW_SIZE];
+
+    while(!isInterruptionRequested()) {
+        if(_resetRequested.fetchAndStoreOrdered(false)) {
+            _crossSpectrumValid = false;
+            _candidate = -1;
+            _agreements = 0;
+            discardPendingSamples();
+        }
+
+        if(jack_ringbuffer_read_space(_referenceRingBuffer) < windowBytes
+        || jack_ringbuffer_read_space(_measuredRingBuffer) < windowBytes) {
+            msleep(50);
+            continue;
+        }
+
+        jack_ringbuffer_read(_referenceRingBuffer, (char*)reference, windowBytes);
+        jack_ringbuffer_read(_measuredRingBuffer, (char*)measured, windowBytes);
+
+        // Skip silent passages, there is nothing to correlate.
+        double energy = 0.0;
+        for(int i = 0; i < WINDOW_SIZE; i++) {
+            _referenceWindow[i] = reference[i];
+            _measuredWindow[i] = measured[i];
+            energy += reference[i] * reference[i];
+        }
+
+        if(energy / WINDOW_SIZE > 1e-8)
+            processWindow();
+    }
+
+    delete[] reference;
+    delete[] measured;
+}
+
+void LatencyTracker::discardPendingSamples() {
+    // The reference signal is always written first, so everything in the
+    // measured ring buffer has its counterpart in the reference ring
+    // buffer. Discarding the same amount from both keeps them aligned.
+    size_t pending = jack_ringbuffer_read_space(_measuredRingBuffer);
+    jack_ringbuffer_read_advance(_measuredRingBuffer, pending);
+    jack_ringbuffer_read_advance(_referenceRingBuffer, pending);
+}
+
+void LatencyTracker::processWindow() {
+    int n = 2 * WINDOW_SIZE;
+    int bins = n / 2 + 1;
+
+    fftw_execute(_referencePlan);
+    fftw_execute(_measuredPlan);
+
+    // Cross spectrum M * conj(R), normalized to unit magnitude (phase
+    // transform) and averaged over the last windows.
+    for(int k = 0; k < bins; k++) {
+        double re = _measuredSpectrum[k][0] * _referenceSpectrum[k][0]
+                  + _measuredSpectrum[k][1] * _referenceSpectrum[k][1];
+        double im = _measuredSpectrum[k][1] * _referenceSpectrum[k][0]
+                  - _measuredSpectrum[k][0] * _referenceSpectrum[k][1];
+        double magnitude = sqrt(re * re + im * im) + 1e-12;
+        re /= magnitude;
+        im /= magnitude;
+
+        if(_crossSpectrumValid) {
+            _crossSpectrum[k][0] = (1.0 - AVERAGING_WEIGHT) * _crossSpectrum[k][0] + AVERAGING_WEIGHT * re;
+            _crossSpectrum[k][1] = (1.0 - AVERAGING_WEIGHT) * _crossSpectrum[k][1] + AVERAGING_WEIGHT * im;
+        } else {
+            _crossSpectrum[k][0] = re;
+            _crossSpectrum[k][1] = im;
+        }
+        _inverseInput[k][0] = _crossSpectrum[k][0];
+        _inverseInput[k][1] = _crossSpectrum[k][1];
+    }
+    _crossSpectrumValid = true;
+
+    fftw_execute(_correlationPlan);
+
+    // The correlation at index k tells how well the measured signal matches
+    // the reference delayed by k samples.
+    int peak = 0;
+    double sum = 0.0;
+    for(int k = 0; k <= _maximumLatency; k++) {
+        sum += _correlation[k] * _correlation[k];
+        if(_correlation[k] > _correlation[peak])
+            peak = k;
+    }
+
+    double rms = sqrt(sum / (_maximumLatency + 1));
+    if(rms <= 0.0 || _correlation[peak] / rms < MINIMUM_PEAK_RATIO) {
+        _agreements = 0;
+        return;
+    }
+
+    if(_candidate >= 0 && qAbs(peak - _candidate) <= PEAK_TOLERANCE) {
+        _agreements++;
+    } else {
+        _candidate = peak;
+        _agreements = 1;
+    }
+
+    if(_agreements >= REQUIRED_AGREEMENTS && _latency.load() != _candidate) {
+        qDebug() << "Latency tracker found a stable latency of" << _candidate << "samples.";
+        _latency.store(_candidate);
+    }
+}
@@ -0,0 +1,146 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LATENCYTRACKER_H
+#define LATENCYTRACKER_H
+
+#include <QThread>
+#include <QAtomicInt>
+
+// JACK includes:
+#include <jack/jack.h>
+#include <jack/ringbuffer.h>
+
+// FFTW3 includes:
+#include "fftw3.h"
+
+/**
+ * @class LatencyTracker
+ *
+ * @author Jacob Dawid ( jacob@omg-it.works )
+ * @author Otto Ritter ( otto.ritter.or@googlemail.com )
+ * @date 09.2011-2016
+ *
+ * @brief Tracks the latency between the reference and the measured signal
+ *        while music is playing.
+ *
+ * The process callback hands both signals over through lock-free ring
+ * buffers. A worker thread cross-correlates them with the generalized
+ * cross-correlation with phase transform (GCC-PHAT), which whitens the
+ * spectrum so that the correlation peak stays sharp for music. A new
+ * latency is only published once the same peak has been found in several
+ * consecutive windows.
+ */
+class LatencyTracker : public QThread {
+    Q_OBJECT
+public:
+    /**
+      * Constructs a new latency tracker.
+      * @param maximumLatency Largest latency in samples that will be detected.
+      */
+    LatencyTracker(int maximumLatency);
+
+    /** Destructor. Stops the worker thread. */
+    ~LatencyTracker();
+
+    /**
+      * Hands over a period of both signals. Safe to call from the process
+      * callback. If the worker falls behind, the period is dropped.
+      * @param reference Reference signal.
+      * @param measured Measured signal.
+      * @param samples Number of samples.
+      */
+    void write(const jack_default_audio_sample_t *reference,
+               const jack_default_audio_sample_t *measured,
+               int samples);
+
+    /** @return The last stable latency in samples, -1 if there is none yet. */
+    int latency();
+
+    /**
+      * Forgets the current estimate and all averaged spectra. Samples
+      * written before are discarded, so that tracking restarts from the
+      * periods written afterwards.
+      */
+    void reset();
+
+protected:
+    /** Reimplemented from QThread. */
+    void run();
+
+private:
+    /** Number of samples correlated at once. */
+    static const int WINDOW_SIZE = 65536;
+
+    /** Number of consecutive windows that have to agree on a peak. */
+    static const int REQUIRED_AGREEMENTS = 3;
+
+    /** Deviation in samples two peaks may have to agree. */
+    static const int PEAK_TOLERANCE = 2;
+
+    /** Minimum ratio of the peak to the RMS of the correlation. */
+    static const double MINIMUM_PEAK_RATIO;
+
+    /** Weight of the newest window in the averaged cross spectrum. */
+    static const double AVERAGING_WEIGHT;
+
+    /** Correlates one window and updates the estimate. */
+    void processWindow();
+
+    /** Discards all samples written so far. Called by the worker thread. */
+    void discardPendingSamples();
+
+    int _maximumLatency;
+
+    jack_ringbuffer_t *_referenceRingBuffer;
+    jack_ringbuffer_t *_measuredRingBuffer;
+
+    /** Last stable latency, -1 if there is none. */
+    QAtomicInt _latency;
+
+    /** Set by reset, handled by the worker thread. */
+    QAtomicInt _resetRequested;
+
+    /** Candidate peak and how many windows agreed on it so far. */
+    int _candidate;
+    int _agreements;
+
+    /** Zero padded time domain windows and their transforms. */
+    double *_referenceWindow;
+    double *_measuredWindow;
+    fftw_complex *_referenceSpectrum;
+    fftw_complex *_measuredSpectrum;
+
+    /** Exponentially averaged, phase transformed cross spectrum. */
+    fftw_complex *_crossSpectrum;
+    bool _crossSpectrumValid;
+
+    /** Cross correlation, the inverse transform of the cross spectrum. */
+    double *_correlation;
+
+    fftw_plan _referencePlan;
+    fftw_plan _measuredPlan;
+    fftw_plan _correlationPlan;
+
+    /** Scratch memory for the cross spectrum handed to the inverse transform. */
+    fftw_complex *_inverseInput;
+};
+
+#endif // LATENCYTRACKER_H
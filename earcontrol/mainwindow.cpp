@@ -27,8 +27,10 @@
 #include <QMessageBox>
 #include <QStandardPaths>
 #include <QMdiSubWindow>
+#include <QInputDialog>
 
 #define FILE_TYPES "*.csv"
+#define PRESET_FILE_TYPES "EAR presets (*.ear)"
 
 MainWindow::MainWindow(DSPCore &dspCore, QWidget *parent) :
     QMainWindow(parent),
@@ -40,10 +42,24 @@ MainWindow::MainWindow(DSPCore &dspCore, QWidget *parent) :
     addEARChannel("Left");
     addEARChannel("Right");
 
+    connect(ui->actionLoadPreset, SIGNAL(triggered()), this, SLOT(loadPreset()));
+    connect(ui->actionSavePreset, SIGNAL(triggered()), this, SLOT(savePreset()));
     connect(ui->actionLoadLeft, SIGNAL(triggered()), this, SLOT(loadLeftEqualizer()));
     connect(ui->actionSaveLeft, SIGNAL(triggered()), this, SLOT(saveLeftEqualizer()));
     connect(ui->actionLoadRight, SIGNAL(triggered()), this, SLOT(loadRightEqualizer()));
     connect(ui->actionSaveRight, SIGNAL(triggered()), this, SLOT(saveRightEqualizer()));
+    connect(ui->calibrateAction, SIGNAL(triggered()), this, SLOT(calibrateAllChannels()));
+    connect(&_dspCore, SIGNAL(parallelCalibrationFinished()), this, SLOT(parallelCalibrationFinished()));
+
+    // Switching between the filters of the bank is meant to be quick, so
+    // each filter has a shortcut.
+    connect(ui->actionLoadPresetIntoBank, SIGNAL(triggered()), this, SLOT(loadPresetIntoBank()));
+    _bankActions = new QActionGroup(this);
+    _bankActions->setExclusive(true);
+    connect(_bankActions, SIGNAL(triggered(QAction*)), this, SLOT(selectBank(QAction*)));
+    addBankAction(Equalizer::LIVE_FILTER, "Live Filter");
+    for(int bank = 0; bank < Equalizer::BANK_SIZE; bank++)
+        addBankAction(bank, QString("Bank %1").arg(bank + 1));
 
     startTimer(200);
 }
@@ -74,6 +90,19 @@ void MainWindow::timerEvent(QTimerEvent *timerEvent) {
                                .arg(_dspCore.client().bufferSize()));
 }
 
+void MainWindow::calibrateAllChannels() {
+    if(!_dspCore.startParallelCalibration()) {
+        QMessageBox::warning(this, "Calibration Not Started",
+                             "Wait for all channels to finish calibrating or measuring.");
+        return;
+    }
+    ui->calibrateAction->setEnabled(false);
+}
+
+void MainWindow::parallelCalibrationFinished() {
+    ui->calibrateAction->setEnabled(true);
+}
+
 void MainWindow::resetControls() {
 //    DigitalEqualizer *leftEqualizer = _dspCore.leftEqualizer();
 //    DigitalEqualizer *rightEqualizer = _dspCore.rightEqualizer();
@@ -92,34 +121,121 @@ void MainWindow::resetControls() {
 //    rightEqualizer->releaseControls();
 }
 
+void MainWindow::loadPreset() {
+    QString homeLocation = QStandardPaths::standardLocations(QStandardPaths::HomeLocation).at(0);
+    QString fileName = QFileDialog::getOpenFileName(this, "Load Preset", homeLocation, PRESET_FILE_TYPES);
+    if(fileName.isEmpty())
+        return;
+
+    if(!_dspCore.loadPreset(fileName)) {
+        QMessageBox::warning(this, "Error Loading File", "There was an error loading the specified file.");
+    }
+
+    // Show the switches of the preset.
+    foreach(QMdiSubWindow *subWindow, ui->mdiArea->subWindowList()) {
+        EARChannelWidget *channelWidget = qobject_cast<EARChannelWidget*>(subWindow->widget());
+        if(channelWidget)
+            channelWidget->updateFromFilter();
+    }
+}
+
+void MainWindow::savePreset() {
+    QString homeLocation = QStandardPaths::standardLocations(QStandardPaths::HomeLocation).at(0);
+    QString fileName = QFileDialog::getSaveFileName(this, "Save Preset", homeLocation, PRESET_FILE_TYPES);
+    if(fileName.isEmpty())
+        return;
+
+    if(!_dspCore.savePreset(fileName)) {
+        QMessageBox::warning(this, "Error Saving File", "There was an error saving the specified file.");
+    }
+}
+
+void MainWindow::addBankAction(int bank, QString text) {
+    QAction *action = new QAction(text, _bankActions);
+    action->setData(bank);
+    action->setCheckable(true);
+    action->setChecked(bank == Equalizer::LIVE_FILTER);
+    action->setShortcut(QKeySequence(QString("Ctrl+%1").arg(bank + 1)));
+    ui->menuFilterBank->addAction(action);
+}
+
+void MainWindow::loadPresetIntoBank() {
+    bool ok;
+    int bank = QInputDialog::getInt(this, "Load Preset into Bank", "Bank:",
+                                    1, 1, Equalizer::BANK_SIZE, 1, &ok);
+    if(!ok)
+        return;
+
+    QString homeLocation = QStandardPaths::standardLocations(QStandardPaths::HomeLocation).at(0);
+    QString fileName = QFileDialog::getOpenFileName(this, "Load Preset into Bank", homeLocation, PRESET_FILE_TYPES);
+    if(fileName.isEmpty())
+        return;
+
+    if(!_dspCore.loadPresetIntoBank(fileName, bank - 1)) {
+        QMessageBox::warning(this, "Error Loading File",
+                             "There was an error loading the specified file. "
+                             "Note that the selected bank cannot be overwritten, "
+                             "switch to another filter first.");
+    }
+}
+
+void MainWindow::selectBank(QAction *action) {
+    if(!_dspCore.selectBank(action->data().toInt())) {
+        QMessageBox::warning(this, "Empty Filter Bank", "There is no filter in this bank for every channel yet.");
+
+        // Check the filter that is still selected again.
+        QList<EARFilter*> filters = _dspCore.earFilters();
+        int selectedBank = filters.isEmpty() ? Equalizer::LIVE_FILTER
+                                             : filters.first()->equalizer()->selectedBank();
+        foreach(QAction *bankAction, _bankActions->actions()) {
+            if(bankAction->data().toInt() == selectedBank)
+                bankAction->setChecked(true);
+        }
+    }
+}
+
+void MainWindow::loadEqualizer(int channel, QString title) {
+    QList<EARFilter*> filters = _dspCore.earFilters();
+    if(channel >= filters.count())
+        return;
+
+    QString homeLocation = QStandardPaths::standardLocations(QStandardPaths::HomeLocation).at(0);
+    QString fileName = QFileDialog::getOpenFileName(this, title, homeLocation, FILE_TYPES);
+    if(fileName.isEmpty())
+        return;
+
+    if(!filters.at(channel)->equalizer()->loadControlsFromFile(fileName)) {
+        QMessageBox::warning(this, "Error Loading File", "There was an error loading the specified file.");
+    }
+}
+
+void MainWindow::saveEqualizer(int channel, QString title) {
+    QList<EARFilter*> filters = _dspCore.earFilters();
+    if(channel >= filters.count())
+        return;
+
+    QString homeLocation = QStandardPaths::standardLocations(QStandardPaths::HomeLocation).at(0);
+    QString fileName = QFileDialog::getSaveFileName(this, title, homeLocation, FILE_TYPES);
+    if(fileName.isEmpty())
+        return;
+
+    if(!filters.at(channel)->equalizer()->saveControlsToFile(fileName)) {
+        QMessageBox::warning(this, "Error Saving File", "There was an error saving the specified file.");
+    }
+}
+
 void MainWindow::loadLeftEqualizer() {
-//    QString homeLocation = QStandardPaths::standardLocations(QStandardPaths::HomeLocation).at(0);
-//    QString fileName = QFileDialog::getOpenFileName(this, "Load Left Equalizer", homeLocation, FILE_TYPES);
-//    if(!_dspCore.leftEqualizer()->loadControlsFromFile(fileName)) {
-//        QMessageBox::warning(this, "Error Loading File", "There was an error loading the specified file.");
-//    }
+    loadEqualizer(0, "Load Left Equalizer");
 }
 
 void MainWindow::loadRightEqualizer() {
-//    QString homeLocation = QStandardPaths::standardLocations(QStandardPaths::HomeLocation).at(0);
-//    QString fileName = QFileDialog::getOpenFileName(this, "Load Right Equalizer", homeLocation, FILE_TYPES);
-//    if(!_dspCore.rightEqualizer()->loadControlsFromFile(fileName)) {
-//        QMessageBox::warning(this, "Error Loading File", "There was an error loading the specified file.");
-//    }
+    loadEqualizer(1, "Load Right Equalizer");
 }
 
 void MainWindow::saveLeftEqualizer() {
-//    QString homeLocation = QStandardPaths::standardLocations(QStandardPaths::HomeLocation).at(0);
-//    QString fileName = QFileDialog::getSaveFileName(this, "Save Left Equalizer", homeLocation, FILE_TYPES);
-//    if(!_dspCore.leftEqualizer()->saveControlsToFile(fileName)) {
-//        QMessageBox::warning(this, "Error Saving File", "There was an error saving the specified file.");
-//    }
+    saveEqualizer(0, "Save Left Equalizer");
 }
 
 void MainWindow::saveRightEqualizer() {
-//    QString homeLocation = QStandardPaths::standardLocations(QStandardPaths::HomeLocation).at(0);
-//    QString fileName = QFileDialog::getSaveFileName(this, "Save Right Equalizer", homeLocation, FILE_TYPES);
-//    if(!_dspCore.rightEqualizer()->saveControlsToFile(fileName)) {
-//        QMessageBox::warning(this, "Error Saving File", "There was an error saving the specified file.");
-//    }
+    saveEqualizer(1, "Save Right Equalizer");
 }
@@ -25,6 +25,7 @@
 #include <QCloseEvent>
 #include <QDesktopServices>
 #include <QTimerEvent>
+#include <QActionGroup>
 
 #include "dspcore.h"
 
@@ -57,9 +58,27 @@ protected:
 
 private slots:
 
+    /** Calibrates the latency of all channels at once. */
+    void calibrateAllChannels();
+
+    /** Allows to calibrate all channels again. */
+    void parallelCalibrationFinished();
+
     /** Resets all equalizer controls to the highest possible value. */
     void resetControls();
 
+    /** Action to load all channels from a preset. */
+    void loadPreset();
+
+    /** Action to save all channels into a preset. */
+    void savePreset();
+
+    /** Action to build the filters of a preset into a bank. */
+    void loadPresetIntoBank();
+
+    /** Switches all channels to the filter of the triggered action. */
+    void selectBank(QAction *action);
+
     /** Action to load the left equalizer. */
     void loadLeftEqualizer();
 
@@ -73,6 +92,18 @@ private slots:
     void saveRightEqualizer();
 
 private:
+    /** Imports the controls of a channel from a CSV file. */
+    void loadEqualizer(int channel, QString title);
+
+    /** Exports the controls of a channel into a CSV file. */
+    void saveEqualizer(int channel, QString title);
+
+    /** Adds an action switching to a filter of the bank. */
+    void addBankAction(int bank, QString text);
+
+    /** Exclusive actions switching between the filters of the bank. */
+    QActionGroup *_bankActions;
+
     /** Ui namespace for automatically generated GUI code. */
     Ui::MainWindow *ui;
 
@@ -0,0 +1,185 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mlsanalyzer.h"
+#include "jnoise/prbsgenerator.h"
+
+#include <cassert>
+#include <cmath>
+
+MLSAnalyzer::MLSAnalyzer(int order) {
+    _order = order;
+    _length = (1 << order) - 1;
+
+    PRBSGenerator prbsGenerator;
+    switch(order) {
+    case 15: prbsGenerator.setPoly(PRBSGenerator::G15); break;
+    case 16: prbsGenerator.setPoly(PRBSGenerator::G16); break;
+    case 17: prbsGenerator.setPoly(PRBSGenerator::G17); break;
+    case 18: prbsGenerator.setPoly(PRBSGenerator::G18); break;
+    case 19: prbsGenerator.setPoly(PRBSGenerator::G19); break;
+    case 20: prbsGenerator.setPoly(PRBSGenerator::G20); break;
+    default: assert(false); break;
+    }
+
+    _sequence = new float[_length];
+    prbsGenerator.sequence(_sequence, _length);
+
+    unsigned char *bits = new unsigned char[_length];
+    for(int i = 0; i < _length; i++)
+        bits[i] = _sequence[i] < 0.0f;
+
+    // The input tag of a sample is the state of the sequence formed by the
+    // last order bits. Each state appears exactly once per period, so this
+    // is a permutation into the indices 1 .. length.
+    _inputTags = new int[_length];
+    for(int i = 0; i < _length; i++) {
+        int tag = 0;
+        for(int j = 0; j < _order; j++)
+            tag |= bits[(_length + i - j) % _length] << (_order - 1 - j);
+        _inputTags[i] = tag;
+    }
+
+    // Find the positions whose tag is a single bit, they define the
+    // permutation that maps the transform back into the time domain.
+    int *unitPositions = new int[_order];
+    for(int i = 0; i < _length; i++) {
+        for(int j = 0; j < _order; j++) {
+            if(_inputTags[i] == (1 << j))
+                unitPositions[j] = i;
+        }
+    }
+
+    _outputTags = new int[_length];
+    for(int i = 0; i < _length; i++) {
+        int tag = 0;
+        for(int j = 0; j < _order; j++)
+            tag |= bits[(2 * _length + unitPositions[j] - i) % _length] << j;
+        _outputTags[i] = tag;
+    }
+
+    delete[] unitPositions;
+    delete[] bits;
+}
+
+MLSAnalyzer::~MLSAnalyzer() {
+    delete[] _sequence;
+    delete[] _inputTags;
+    delete[] _outputTags;
+}
+
+int MLSAnalyzer::order() const {
+    return _order;
+}
+
+int MLSAnalyzer::length() const {
+    return _length;
+}
+
+int MLSAnalyzer::workspaceSize() const {
+    return _length + 1;
+}
+
+void MLSAnalyzer::excitation(float *out, int start, int n, float amplitude) const {
+    int position = start % _length;
+    for(int i = 0; i < n; i++) {
+        out[i] = amplitude * _sequence[position];
+        if(++position == _length)
+            position = 0;
+    }
+}
+
+void MLSAnalyzer::reset(float *workspace) const {
+    for(int i = 0; i <= _length; i++)
+        workspace[i] = 0.0f;
+}
+
+void MLSAnalyzer::accumulate(float *workspace, int start, const float *samples, int n) const {
+    int position = start % _length;
+    for(int i = 0; i < n; i++) {
+        workspace[_inputTags[position]] = samples[i];
+        // The first element of the workspace takes the negative sum of
+        // all samples, which removes the dc offset of the sequence.
+        workspace[0] -= samples[i];
+        if(++position == _length)
+            position = 0;
+    }
+}
+
+void MLSAnalyzer::transform(float *workspace) const {
+    int size = _length + 1;
+    for(int span = size; span > 1; span >>= 1) {
+        int half = span >> 1;
+        for(int j = 0; j < half; j++) {
+            for(int i = j; i < size; i += span) {
+                float sum = workspace[i] + workspace[i + half];
+                workspace[i + half] = workspace[i] - workspace[i + half];
+                workspace[i] = sum;
+            }
+        }
+    }
+}
+
+float MLSAnalyzer::impulseResponse(const float *workspace, int index) const {
+    return workspace[_outputTags[index % _length]] / (float)(_length + 1);
+}
+
+void MLSAnalyzer::findPeak(const float *workspace, int from, int count,
+                           double *position, double *snr) const {
+    int peak = 0;
+    float peakValue = 0.0f;
+    for(int i = 0; i < count; i++) {
+        float value = fabsf(impulseResponse(workspace, from + i));
+        if(value > peakValue) {
+            peak = i;
+            peakValue = value;
+        }
+    }
+
+    // Interpolate the peak with a parabola through its neighbours.
+    double offset = 0.0;
+    if(peak > 0 && peak < count - 1) {
+        double left = fabs(impulseResponse(workspace, from + peak - 1));
+        double right = fabs(impulseResponse(workspace, from + peak + 1));
+        double denominator = left - 2.0 * peakValue + right;
+        if(denominator != 0.0)
+            offset = 0.5 * (left - right) / denominator;
+    }
+    *position = peak + offset;
+
+    // Nothing arrives before the direct sound, so the part of the range
+    // before the peak only contains noise. If that part is too short, use
+    // the end of the range instead.
+    const int guard = 16, minimumNoiseSamples = 256;
+    int noiseFrom = 0, noiseCount = peak - guard;
+    if(noiseCount < minimumNoiseSamples) {
+        noiseCount = count / 4;
+        noiseFrom = count - noiseCount;
+    }
+
+    double noise = 0.0;
+    for(int i = noiseFrom; i < noiseFrom + noiseCount; i++) {
+        double value = impulseResponse(workspace, from + i);
+        noise += value * value;
+    }
+    noise /= noiseCount > 0 ? noiseCount : 1;
+
+    *snr = 10.0 * log10((peakValue * peakValue + 1e-20) / (noise + 1e-20));
+}
@@ -0,0 +1,117 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MLSANALYZER_H
+#define MLSANALYZER_H
+
+/**
+ * @class MLSAnalyzer
+ *
+ * @author Jacob Dawid ( jacob@omg-it.works )
+ * @author Otto Ritter ( otto.ritter.or@googlemail.com )
+ * @date 09.2011-2016
+ *
+ * @brief Measures impulse responses with maximum length sequences.
+ *
+ * Plays a maximum length sequence (MLS) generated by the PRBSGenerator and
+ * recovers the circular impulse response from one recorded period with a
+ * fast Hadamard transform. The recorded samples are permuted into a
+ * workspace as they arrive, so the recording itself does not need to be
+ * stored.
+ */
+class MLSAnalyzer {
+public:
+    /**
+      * Constructs an analyzer for the given sequence order.
+      * @param order Order of the sequence, the sequence will be
+      *        2^order - 1 samples long. Supported are 15 to 20.
+      */
+    MLSAnalyzer(int order);
+
+    /** Destructor. */
+    ~MLSAnalyzer();
+
+    /** @return The order of the sequence. */
+    int order() const;
+
+    /** @return The length of the sequence in samples. */
+    int length() const;
+
+    /** @return Number of floats a workspace needs to hold. */
+    int workspaceSize() const;
+
+    /**
+      * Writes the excitation signal.
+      * @param out Output buffer.
+      * @param start Position in the sequence of the first sample, may
+      *        exceed the length of the sequence.
+      * @param n Number of samples.
+      * @param amplitude Amplitude of the excitation.
+      */
+    void excitation(float *out, int start, int n, float amplitude) const;
+
+    /** Clears the workspace before recording a new period. */
+    void reset(float *workspace) const;
+
+    /**
+      * Adds recorded samples to the workspace.
+      * @param workspace Workspace of workspaceSize() floats.
+      * @param start Position in the sequence the first sample has been
+      *        recorded at, may exceed the length of the sequence.
+      * @param samples Recorded samples.
+      * @param n Number of samples.
+      */
+    void accumulate(float *workspace, int start, const float *samples, int n) const;
+
+    /** Performs the fast Hadamard transform after a full period has been
+      * accumulated. Afterwards the impulse response can be read. */
+    void transform(float *workspace) const;
+
+    /** @return Sample of the impulse response at the given index. */
+    float impulseResponse(const float *workspace, int index) const;
+
+    /**
+      * Searches the strongest peak of the impulse response in a range.
+      * @param workspace Transformed workspace.
+      * @param from First index of the range.
+      * @param count Number of samples in the range.
+      * @param position Receives the position of the peak, relative to
+      *        from and with sub-sample accuracy.
+      * @param snr Receives the ratio of the peak to the noise floor before
+      *        the peak in dB.
+      */
+    void findPeak(const float *workspace, int from, int count,
+                  double *position, double *snr) const;
+
+private:
+    int _order;
+    int _length;
+
+    /** Excitation signal, one period of +1 and -1. */
+    float *_sequence;
+
+    /** Permutation of the recorded samples into the workspace. */
+    int *_inputTags;
+
+    /** Permutation of the transformed workspace into the impulse response. */
+    int *_outputTags;
+};
+
+#endif // MLSANALYZER_H
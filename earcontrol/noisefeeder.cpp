@@ -0,0 +1,79 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "noisefeeder.h"
+
+NoiseFeeder::NoiseFeeder()
+    : QThread() {
+    for(int c = 0; c < 2; c++) {
+        _ringBuffers[c] = jack_ringbuffer_create(RING_BUFFER_SIZE * sizeof(jack_default_audio_sample_t));
+        jack_ringbuffer_mlock(_ringBuffers[c]);
+    }
+}
+
+NoiseFeeder::~NoiseFeeder() {
+    requestInterruption();
+    wait();
+
+    jack_ringbuffer_free(_ringBuffers[White]);
+    jack_ringbuffer_free(_ringBuffers[Pink]);
+}
+
+void NoiseFeeder::seed(uint32_t seed, int substream) {
+    for(int c = 0; c < 2; c++) {
+        _noiseGenerators[c].seed(seed, substream + c);
+        jack_ringbuffer_reset(_ringBuffers[c]);
+    }
+}
+
+bool NoiseFeeder::read(Color color, jack_default_audio_sample_t *out, int samples) {
+    size_t bytes = samples * sizeof(jack_default_audio_sample_t);
+    if(jack_ringbuffer_read_space(_ringBuffers[color]) < bytes)
+        return false;
+    jack_ringbuffer_read(_ringBuffers[color], (char*)out, bytes);
+    return true;
+}
+
+void NoiseFeeder::run() {
+    size_t chunkBytes = CHUNK_SIZE * sizeof(jack_default_audio_sample_t);
+    jack_default_audio_sample_t *chunk = new jack_default_audio_sample_t[CHUNK_SIZE];
+
+    while(!isInterruptionRequested()) {
+        bool idle = true;
+        for(int c = 0; c < 2; c++) {
+            if(jack_ringbuffer_write_space(_ringBuffers[c]) < chunkBytes)
+                continue;
+
+            if(c == White)
+                _noiseGenerators[c].processWhite(CHUNK_SIZE, chunk);
+            else
+                _noiseGenerators[c].processPink(CHUNK_SIZE, chunk);
+            jack_ringbuffer_write(_ringBuffers[c], (const char*)chunk, chunkBytes);
+            idle = false;
+        }
+
+        // Each ring buffer holds several periods, so there is plenty of time
+        // to refill it.
+        if(idle)
+            msleep(10);
+    }
+
+    delete[] chunk;
+}
@@ -0,0 +1,100 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NOISEFEEDER_H
+#define NOISEFEEDER_H
+
+#include <QThread>
+
+// JACK includes:
+#include <jack/jack.h>
+#include <jack/ringbuffer.h>
+
+#include "jnoise/jnoise.h"
+
+/**
+ * @class NoiseFeeder
+ *
+ * @author Jacob Dawid ( jacob@omg-it.works )
+ * @author Otto Ritter ( otto.ritter.or@googlemail.com )
+ * @date 09.2011-2016
+ *
+ * @brief Generates white and pink noise ahead of the process callback.
+ *
+ * A worker thread keeps a lock-free ring buffer per color filled with noise,
+ * so the process callback only has to copy a period out of it. The noise is
+ * generated from a seeded substream and therefore reproducible.
+ */
+class NoiseFeeder : public QThread {
+    Q_OBJECT
+public:
+    /** Spectral colors of the noise. */
+    enum Color {
+        White,
+        Pink
+    };
+
+    /** Constructs a new noise feeder, seeded from the current time. */
+    NoiseFeeder();
+
+    /** Destructor. Stops the worker thread. */
+    ~NoiseFeeder();
+
+    /** Number of substreams of a seed used by a noise feeder. */
+    static const int SUBSTREAMS = 2;
+
+    /**
+      * Restarts the noise on substreams of a seed, see JNoise::seed(). Each
+      * color has a substream of its own, so the noise does not depend on
+      * when the ring buffers are refilled. Uses the substreams from
+      * substream to substream + SUBSTREAMS - 1. Must not be called while
+      * the worker thread is running.
+      * @param seed Seed, zero seeds from the current time.
+      * @param substream Index of the first substream.
+      */
+    void seed(uint32_t seed, int substream);
+
+    /**
+      * Takes generated noise out of the ring buffer. Safe to call from the
+      * process callback.
+      * @param color Spectral color of the noise.
+      * @param out Receives the noise.
+      * @param samples Number of samples.
+      * @return false, if the worker has not generated enough noise yet. In
+      *         this case nothing is taken out.
+      */
+    bool read(Color color, jack_default_audio_sample_t *out, int samples);
+
+protected:
+    /** Reimplemented from QThread. */
+    void run();
+
+private:
+    /** Number of samples the ring buffers hold. */
+    static const int RING_BUFFER_SIZE = 16384;
+
+    /** Number of samples generated at once. */
+    static const int CHUNK_SIZE = 1024;
+
+    jack_ringbuffer_t *_ringBuffers[2];
+    JNoise _noiseGenerators[2];
+};
+
+#endif // NOISEFEEDER_H
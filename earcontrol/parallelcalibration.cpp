@@ -0,0 +1,110 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "parallelcalibration.h"
+
+#include <QDebug>
+
+int ParallelCalibration::orderForChannels(int channels) {
+    if(channels < 1)
+        return 0;
+
+    int slotLength = EARFilter::maximumLatency() + REVERBERATION_TAIL;
+    for(int order = 16; order <= 20; order++) {
+        if(((1 << order) - 1) / channels >= slotLength)
+            return order;
+    }
+    return 0;
+}
+
+ParallelCalibration::ParallelCalibration(QList<EARFilter*> earFilters) :
+    QThread(),
+    _earFilters(earFilters) {
+    _sequence = 0;
+
+    int order = orderForChannels(_earFilters.count());
+    if(order) {
+        _sequence = new MLSAnalyzer(order);
+        foreach(EARFilter *earFilter, _earFilters) {
+            Q_UNUSED(earFilter);
+            _workspaces.append(new float[_sequence->workspaceSize()]());
+        }
+    } else {
+        qDebug() << "Unable to calibrate" << _earFilters.count() << "channels at once.";
+    }
+}
+
+ParallelCalibration::~ParallelCalibration() {
+    requestInterruption();
+    wait();
+    foreach(float *workspace, _workspaces)
+        delete[] workspace;
+    delete _sequence;
+}
+
+bool ParallelCalibration::startChannels() {
+    if(!_sequence)
+        return false;
+
+    int slotLength = _sequence->length() / _earFilters.count();
+    for(int i = 0; i < _earFilters.count(); i++) {
+        if(!_earFilters.at(i)->startParallelCalibration(_sequence, _workspaces.at(i),
+                                                        i * slotLength, slotLength)) {
+            for(int j = 0; j < i; j++)
+                _earFilters.at(j)->cancelCalibration(_sequence);
+            return false;
+        }
+    }
+    return true;
+}
+
+void ParallelCalibration::run() {
+    if(!_sequence)
+        return;
+
+    // Wait until every channel has recorded a full period. A channel may
+    // never do so, e.g. when JACK stops or the channel is switched to
+    // another mode, so give up after twice the time a recording takes.
+    int sampleRate = qMax(_earFilters.first()->sampleRate(), 1);
+    qint64 recordingLength = EARFilter::maximumLatency() + _sequence->length();
+    qint64 timeout = 2000 * recordingLength / sampleRate + TIMEOUT_MARGIN;
+
+    bool recorded = false;
+    for(qint64 waited = 0; !recorded && waited < timeout; waited += POLLING_INTERVAL) {
+        if(isInterruptionRequested())
+            break;
+        msleep(POLLING_INTERVAL);
+        recorded = true;
+        foreach(EARFilter *earFilter, _earFilters)
+            recorded = recorded && earFilter->calibrationRecorded();
+    }
+
+    if(!recorded && !isInterruptionRequested())
+        qDebug() << "Parallel calibration timed out.";
+
+    // Analyze what has been recorded, the other channels go back to
+    // processing audio.
+    foreach(EARFilter *earFilter, _earFilters) {
+        if(earFilter->takeCalibrationRecording())
+            earFilter->analyzeCalibration();
+        else
+            earFilter->cancelCalibration(_sequence);
+    }
+}
@@ -0,0 +1,102 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PARALLELCALIBRATION_H
+#define PARALLELCALIBRATION_H
+
+#include <QThread>
+#include <QList>
+#include <QVector>
+
+#include "earfilter.h"
+#include "mlsanalyzer.h"
+
+/**
+ * @class ParallelCalibration
+ *
+ * @author Jacob Dawid ( jacob@omg-it.works )
+ * @author Otto Ritter ( otto.ritter.or@googlemail.com )
+ * @date 09.2011-2016
+ *
+ * @brief Calibrates the latency of all channels at once.
+ *
+ * All channels play the same maximum length sequence, channel k shifted
+ * circularly by k slots of length / channels samples. Shifted versions of
+ * a maximum length sequence are orthogonal, so the impulse response of
+ * each microphone shows the response to every output in its own slot.
+ * Each filter accumulates its recording with its own shift, which puts
+ * the response to its own output into the first slot. The order of the
+ * sequence is picked so that a slot covers the maximum latency.
+ *
+ * The filters record in the process callback. Transforming the large
+ * sequences takes too long for a period, so a worker thread waits for all
+ * recordings and analyzes them. The channels are switched to the
+ * calibration by startChannels() before the worker thread is started.
+ */
+class ParallelCalibration : public QThread {
+    Q_OBJECT
+public:
+    /** Samples a slot reserves for the reverberation after the maximum
+      * latency. */
+    static const int REVERBERATION_TAIL = 8192;
+
+    /**
+      * Picks the order of the sequence for the given number of channels.
+      * @return The order, or zero if there are no or too many channels.
+      */
+    static int orderForChannels(int channels);
+
+    /**
+      * Constructs a new parallel calibration. Allocates the sequence and
+      * all workspaces, so do not call from the process callback.
+      * @param earFilters Filters to calibrate.
+      */
+    ParallelCalibration(QList<EARFilter*> earFilters);
+
+    /** Destructor. Stops the worker thread. */
+    ~ParallelCalibration();
+
+    /**
+      * Switches all channels to the calibration. Call this from the GUI
+      * thread, like the calibration of a single channel, before starting
+      * the worker thread.
+      * @return false, if a channel is calibrating or measuring already. No
+      *         channel is calibrating then.
+      */
+    bool startChannels();
+
+protected:
+    /** Reimplemented from QThread. */
+    void run();
+
+private:
+    /** Interval in milliseconds to check for the recordings. */
+    static const int POLLING_INTERVAL = 50;
+
+    /** Time in milliseconds waited for the recordings on top of twice
+      * their duration. */
+    static const int TIMEOUT_MARGIN = 2000;
+
+    QList<EARFilter*> _earFilters;
+    MLSAnalyzer *_sequence;
+    QVector<float*> _workspaces;
+};
+
+#endif // PARALLELCALIBRATION_H
@@ -0,0 +1,101 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "periodicnoise.h"
+#include "fftwadapter.h"
+#include "jnoise/randomgenerator.h"
+
+#include <cmath>
+
+const double PeriodicNoise::RMS_LEVEL = 0.1;
+
+/** Seed of the phases, so the noise is the same on every run. */
+static const uint32_t PHASE_SEED = 0x45415221;
+
+PeriodicNoise::PeriodicNoise() {
+    synthesize(PHASE_SEED);
+}
+
+PeriodicNoise::~PeriodicNoise() {
+}
+
+void PeriodicNoise::synthesize(uint32_t seed) {
+    for(int c = 0; c < 2; c++) {
+        for(int period = MIN_PERIOD; period <= MAX_PERIOD; period *= 2)
+            synthesize((Color)c, period, seed, _tables[c] + tableOffset(period));
+    }
+    _position = 0;
+}
+
+const jack_default_audio_sample_t *PeriodicNoise::table(Color color, int period) const {
+    if(period < MIN_PERIOD || period > MAX_PERIOD || (period & (period - 1)))
+        return 0;
+    return _tables[color] + tableOffset(period);
+}
+
+void PeriodicNoise::process(Color color, jack_default_audio_sample_t *out, int samples) {
+    const jack_default_audio_sample_t *longest = table(color, MAX_PERIOD);
+    for(int i = 0; i < samples; i++) {
+        out[i] = longest[_position];
+        if(++_position == MAX_PERIOD)
+            _position = 0;
+    }
+}
+
+int PeriodicNoise::tableOffset(int period) {
+    return period - MIN_PERIOD;
+}
+
+void PeriodicNoise::synthesize(Color color, int period, uint32_t seed,
+                               jack_default_audio_sample_t *table) {
+    fftw_complex *spectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * period);
+    fftw_complex *signal = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * period);
+
+    RandomGenerator randomGenerator;
+    randomGenerator.init(seed + period);
+
+    // Every bin between DC and the nyquist frequency gets the magnitude of
+    // the color and a random phase. The upper half mirrors the lower half
+    // conjugated, so the signal is real.
+    for(int k = 0; k < period; k++) {
+        spectrum[k][0] = 0.0;
+        spectrum[k][1] = 0.0;
+    }
+    for(int k = 1; k < period / 2; k++) {
+        double magnitude = color == Pink ? 1.0 / sqrt((double)k) : 1.0;
+        double phase = 2.0 * M_PI * randomGenerator.urand();
+        spectrum[k][0] = magnitude * cos(phase);
+        spectrum[k][1] = magnitude * sin(phase);
+        spectrum[period - k][0] = spectrum[k][0];
+        spectrum[period - k][1] = -spectrum[k][1];
+    }
+
+    FFTWAdapter::performInverseFFT(spectrum, signal, period);
+
+    double power = 0.0;
+    for(int i = 0; i < period; i++)
+        power += signal[i][0] * signal[i][0];
+    double gain = RMS_LEVEL / sqrt(power / period);
+    for(int i = 0; i < period; i++)
+        table[i] = signal[i][0] * gain;
+
+    fftw_free(spectrum);
+    fftw_free(signal);
+}
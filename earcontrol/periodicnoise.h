@@ -0,0 +1,111 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PERIODICNOISE_H
+#define PERIODICNOISE_H
+
+// JACK includes:
+#include <jack/jack.h>
+
+/**
+ * @class PeriodicNoise
+ *
+ * @author Jacob Dawid ( jacob@omg-it.works )
+ * @author Otto Ritter ( otto.ritter.or@googlemail.com )
+ * @date 09.2011-2016
+ *
+ * @brief Noise that repeats itself with the period of the analysis frames.
+ *
+ * The noise is synthesized once in the frequency domain, with exactly the
+ * white or pink magnitude in every bin and a random phase, and transformed
+ * into a table of one period. There is a table for every power of two
+ * period JACK is usually run with. Played with a period equal to the
+ * analysis frame, every frame contains exactly one period of the steady
+ * state response. Such a frame can be analyzed without a window and without
+ * spectral leakage, and a handful of frames is enough to average out the
+ * noise of the measurement.
+ */
+class PeriodicNoise {
+public:
+    /** Spectral colors of the noise. */
+    enum Color {
+        White,
+        Pink
+    };
+
+    /** Shortest period a table is synthesized for. */
+    static const int MIN_PERIOD = 32;
+
+    /** Longest period a table is synthesized for. */
+    static const int MAX_PERIOD = 4096;
+
+    /** RMS level of the noise. */
+    static const double RMS_LEVEL;
+
+    /** Synthesizes the tables with the default seed. Not real time safe. */
+    PeriodicNoise();
+
+    /** Destructor. */
+    ~PeriodicNoise();
+
+    /**
+      * Synthesizes the tables again with other random phases. Noise with
+      * different seeds is uncorrelated, as long as the period is long
+      * enough. Not real time safe.
+      * @param seed Seed of the phases.
+      */
+    void synthesize(uint32_t seed);
+
+    /**
+      * Looks up the table for a period.
+      * @param color Spectral color of the noise.
+      * @param period Period in samples.
+      * @return One period of the noise, or null if there is no table for
+      *         this period.
+      */
+    const jack_default_audio_sample_t *table(Color color, int period) const;
+
+    /**
+      * Plays the longest table in a loop. For periods without a table of
+      * their own, which are not leakage free.
+      * @param color Spectral color of the noise.
+      * @param out Receives the noise.
+      * @param samples Number of samples.
+      */
+    void process(Color color, jack_default_audio_sample_t *out, int samples);
+
+private:
+    /** Synthesizes one period into the table. */
+    void synthesize(Color color, int period, uint32_t seed,
+                    jack_default_audio_sample_t *table);
+
+    /** @return Offset of the table for a power of two period. */
+    static int tableOffset(int period);
+
+    /** Tables of all periods for both colors. The tables of all periods
+      * from MIN_PERIOD to MAX_PERIOD fit into twice the longest one. Kept
+      * inline, so that they are part of the locked block of the channel. */
+    jack_default_audio_sample_t _tables[2][MAX_PERIOD * 2];
+
+    /** Position in the longest table when looping it. */
+    int _position;
+};
+
+#endif // PERIODICNOISE_H
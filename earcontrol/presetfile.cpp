@@ -0,0 +1,148 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "presetfile.h"
+
+#include <QDebug>
+
+PresetFile::PresetFile() {
+    Q_STATIC_ASSERT(sizeof(Header) % sizeof(double) == 0);
+    Q_STATIC_ASSERT(sizeof(Channel) % sizeof(double) == 0);
+
+    _file = 0;
+    _memory = 0;
+    _header = 0;
+    _channels = 0;
+}
+
+PresetFile::~PresetFile() {
+    close();
+}
+
+bool PresetFile::open(QString fileName) {
+    close();
+
+    _file = new QFile(fileName);
+    if(!_file->open(QFile::ReadOnly)) {
+        close();
+        return false;
+    }
+
+    qint64 size = _file->size();
+    if(size < (qint64)sizeof(Header)) {
+        qDebug() << "Preset file too short:" << fileName;
+        close();
+        return false;
+    }
+
+    _memory = _file->map(0, size);
+    if(!_memory) {
+        close();
+        return false;
+    }
+
+    const Header *header = (const Header*)_memory;
+    if(header->m_magic != MAGIC) {
+        qDebug() << "Not a preset file, or written on a machine of the other byte order:" << fileName;
+        close();
+        return false;
+    }
+
+    if(header->m_version != VERSION) {
+        qDebug() << "Unsupported preset version" << header->m_version << "in" << fileName;
+        close();
+        return false;
+    }
+
+    qint64 recordsSize = (qint64)header->m_channels * sizeof(Channel);
+    if(size != (qint64)sizeof(Header) + recordsSize) {
+        qDebug() << "Preset file has the wrong size:" << fileName;
+        close();
+        return false;
+    }
+
+    if(crc32(_memory + sizeof(Header), recordsSize) != header->m_checksum) {
+        qDebug() << "Preset file is corrupted:" << fileName;
+        close();
+        return false;
+    }
+
+    _header = header;
+    _channels = (const Channel*)(_memory + sizeof(Header));
+    return true;
+}
+
+int PresetFile::channels() const {
+    return _header ? _header->m_channels : 0;
+}
+
+const PresetFile::Channel *PresetFile::channel(int index) const {
+    return _channels + index;
+}
+
+bool PresetFile::write(QString fileName, const Channel *channels, int count) {
+    Header header;
+    header.m_magic = MAGIC;
+    header.m_version = VERSION;
+    header.m_channels = count;
+    header.m_checksum = crc32((const uchar*)channels, (qint64)count * sizeof(Channel));
+
+    QFile file(fileName);
+    if(!file.open(QFile::WriteOnly))
+        return false;
+
+    qint64 recordsSize = (qint64)count * sizeof(Channel);
+    bool written = file.write((const char*)&header, sizeof(Header)) == (qint64)sizeof(Header)
+                && file.write((const char*)channels, recordsSize) == recordsSize;
+    file.close();
+    return written;
+}
+
+quint32 PresetFile::crc32(const uchar *data, qint64 size) {
+    static quint32 table[256];
+    static bool tableReady = false;
+    if(!tableReady) {
+        for(quint32 i = 0; i < 256; i++) {
+            quint32 c = i;
+            for(int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        tableReady = true;
+    }
+
+    quint32 crc = 0xffffffff;
+    for(qint64 i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffff;
+}
+
+void PresetFile::close() {
+    if(_file) {
+        if(_memory)
+            _file->unmap(_memory);
+        _file->close();
+        delete _file;
+    }
+    _file = 0;
+    _memory = 0;
+    _header = 0;
+    _channels = 0;
+}
@@ -0,0 +1,126 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PRESETFILE_H
+#define PRESETFILE_H
+
+#include <QFile>
+#include <QString>
+#include <QtGlobal>
+
+#include "controlgrid.h"
+#include "dspkernels.h"
+
+/**
+ * @class PresetFile
+ *
+ * @author Jacob Dawid ( jacob@omg-it.works )
+ * @author Otto Ritter ( otto.ritter.or@googlemail.com )
+ * @date 09.2011-2016
+ *
+ * @brief Binary preset holding the state of all channels.
+ *
+ * The file consists of a header followed by one fixed size record per
+ * channel, in the byte order of the machine that wrote it. The records are
+ * protected by a CRC-32 in the header. A preset is mapped into memory and
+ * the records are used right where they are, there is nothing to parse.
+ */
+class PresetFile {
+public:
+    /** "EARP" as read in little endian byte order. */
+    static const quint32 MAGIC = 0x50524145;
+
+    /** Current version of the format. Increment on every change of the
+      * records. */
+    static const quint32 VERSION = 1;
+
+    /** Switches of a channel. */
+    enum ChannelFlag {
+        AutomaticAdaptionActive = 1,
+        BypassActive = 2,
+        LatencyTrackingActive = 4
+    };
+
+    struct Header {
+        quint32 m_magic;
+        quint32 m_version;
+        /** Number of channel records following the header. */
+        quint32 m_channels;
+        /** CRC-32 of all channel records. */
+        quint32 m_checksum;
+    };
+
+    /** State of one channel. The enums are stored as their values. */
+    struct Channel {
+        qint32 m_bandsPerOctave;
+        qint32 m_sampleRate;
+        qint32 m_numberOfControls;
+        qint32 m_latency;
+        qint32 m_signalSource;
+        qint32 m_adaptionEngine;
+        qint32 m_calibrationMethod;
+        /** Combination of ChannelFlag values. */
+        qint32 m_flags;
+        double m_controls[ControlGrid::MAX_BANDS];
+        /** Filter designed from the controls, for the sample rate above. */
+        double m_coefficients[DSPKernels::FILTER_TAPS];
+    };
+
+    PresetFile();
+
+    /** Destructor. Unmaps the file. */
+    ~PresetFile();
+
+    /**
+      * Maps a preset file into memory and verifies it.
+      * @param fileName Name of the preset file.
+      * @return true, if the file is a valid preset of the current version.
+      */
+    bool open(QString fileName);
+
+    /** @return Number of channels of the opened preset. */
+    int channels() const;
+
+    /** @return Record of a channel, pointing into the mapped file. */
+    const Channel *channel(int index) const;
+
+    /**
+      * Writes a preset file.
+      * @param fileName Name of the preset file.
+      * @param channels Records of all channels.
+      * @param count Number of channels.
+      * @return true on success, otherwise false.
+      */
+    static bool write(QString fileName, const Channel *channels, int count);
+
+    /** @return CRC-32 of the data, as used by zlib and PNG. */
+    static quint32 crc32(const uchar *data, qint64 size);
+
+private:
+    /** Unmaps and closes the file. */
+    void close();
+
+    QFile *_file;
+    uchar *_memory;
+    const Header *_header;
+    const Channel *_channels;
+};
+
+#endif // PRESETFILE_H
@@ -0,0 +1,112 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "spectralestimator.h"
+
+#include <cmath>
+
+const double SpectralEstimator::AVERAGING_WEIGHT = 0.1;
+const double SpectralEstimator::POWER_FLOOR = 1e-12;
+
+SpectralEstimator::SpectralEstimator() {
+    reset();
+}
+
+void SpectralEstimator::reset() {
+    _bands = 0;
+    _frameSize = 0;
+    for(int i = 0; i < MAX_BINS; i++) {
+        _referenceDensity[i] = 0.0;
+        _measuredDensity[i] = 0.0;
+        _crossDensity[i][0] = 0.0;
+        _crossDensity[i][1] = 0.0;
+    }
+    for(int i = 0; i < ControlGrid::MAX_BANDS; i++) {
+        _referencePower[i] = 0.0;
+        _measuredPower[i] = 0.0;
+        _crossMagnitude[i] = 0.0;
+        _coherentPower[i] = 0.0;
+    }
+}
+
+void SpectralEstimator::update(const fftw_complex *reference, const fftw_complex *measured,
+                               const ControlGrid::BinRange *ranges, int bands, int frameSize) {
+    if(bands <= 0 || frameSize / 2 + 1 > MAX_BINS)
+        return;
+    if(bands != _bands || frameSize != _frameSize) {
+        reset();
+        _bands = bands;
+        _frameSize = frameSize;
+    }
+
+    // Normalize to the frame size, so the power floor does not depend on
+    // the period.
+    const double scale = 1.0 / ((double)frameSize * frameSize);
+    const double weight = AVERAGING_WEIGHT;
+
+    // Neighbouring bands may share a bin, so average each bin once.
+    for(int j = ranges[0].first; j <= ranges[bands - 1].last; j++) {
+        double xr = reference[j][0], xi = reference[j][1];
+        double yr = measured[j][0], yi = measured[j][1];
+
+        // conj(X) * Y
+        double crossReal = xr * yr + xi * yi;
+        double crossImaginary = xr * yi - xi * yr;
+
+        _referenceDensity[j] += weight * ((xr * xr + xi * xi) * scale - _referenceDensity[j]);
+        _measuredDensity[j] += weight * ((yr * yr + yi * yi) * scale - _measuredDensity[j]);
+        _crossDensity[j][0] += weight * (crossReal * scale - _crossDensity[j][0]);
+        _crossDensity[j][1] += weight * (crossImaginary * scale - _crossDensity[j][1]);
+    }
+
+    for(int i = 0; i < bands; i++) {
+        double referencePower = 0.0, measuredPower = 0.0;
+        double crossMagnitude = 0.0, coherentPower = 0.0;
+
+        for(int j = ranges[i].first; j <= ranges[i].last; j++) {
+            double cross = _crossDensity[j][0] * _crossDensity[j][0]
+                         + _crossDensity[j][1] * _crossDensity[j][1];
+            referencePower += _referenceDensity[j];
+            measuredPower += _measuredDensity[j];
+            crossMagnitude += sqrt(cross);
+
+            // Sxx * |Sxy|^2 / (Sxx * Syy)
+            if(_measuredDensity[j] > 0.0)
+                coherentPower += cross / _measuredDensity[j];
+        }
+
+        _referencePower[i] = referencePower;
+        _measuredPower[i] = measuredPower;
+        _crossMagnitude[i] = crossMagnitude;
+        _coherentPower[i] = coherentPower;
+    }
+}
+
+double SpectralEstimator::magnitude(int band) const {
+    if(_referencePower[band] <= 0.0)
+        return 0.0;
+    return _crossMagnitude[band] / _referencePower[band];
+}
+
+double SpectralEstimator::coherence(int band) const {
+    if(_referencePower[band] <= 0.0)
+        return 0.0;
+    return _coherentPower[band] / _referencePower[band];
+}
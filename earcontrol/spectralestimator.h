@@ -0,0 +1,113 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPECTRALESTIMATOR_H
+#define SPECTRALESTIMATOR_H
+
+// FFTW3 includes:
+#include "fftw3.h"
+
+#include "controlgrid.h"
+#include "dspkernels.h"
+
+/**
+ * @class SpectralEstimator
+ *
+ * @author Jacob Dawid ( jacob@omg-it.works )
+ * @author Otto Ritter ( otto.ritter.or@googlemail.com )
+ * @date 09.2011-2016
+ *
+ * @brief Estimates the transfer function from the reference to the
+ *        measured signal.
+ *
+ * Averages the auto spectral densities of both signals and their cross
+ * spectral density exponentially over consecutive frames, for each bin on
+ * its own. The H1 estimate Sxy / Sxx is unbiased by noise on the measured
+ * signal, and the coherence tells how much of the measured signal is
+ * explained by the reference. Magnitude and coherence are reduced to the
+ * control bands only afterwards, weighted by the reference power, as the
+ * phase of the transfer function changes from bin to bin within wide bands.
+ */
+class SpectralEstimator {
+public:
+    /** Weight of a new frame in the exponential average. */
+    static const double AVERAGING_WEIGHT;
+
+    /** Normalized reference power below which a band is considered silent. */
+    static const double POWER_FLOOR;
+
+    /** Largest number of bins of the spectra. */
+    static const int MAX_BINS = DSPKernels::MAX_BLOCK_SIZE / 2 + 1;
+
+    SpectralEstimator();
+
+    /** Forgets all averaged spectra. */
+    void reset();
+
+    /** @return Number of bands of the averaged spectra, zero after reset. */
+    int bands() const { return _bands; }
+
+    /**
+      * Adds a frame to the averages. Resets the averages if the number of
+      * bands or the frame size has changed.
+      * @param reference Spectrum of the reference signal.
+      * @param measured Spectrum of the measured signal.
+      * @param ranges Bins of each band, in ascending order.
+      * @param bands Number of bands.
+      * @param frameSize Number of samples the spectra have been taken from.
+      */
+    void update(const fftw_complex *reference, const fftw_complex *measured,
+                const ControlGrid::BinRange *ranges, int bands, int frameSize);
+
+    /** @return True, if the reference carries enough power in this band to
+      *         estimate anything. */
+    bool active(int band) const { return _referencePower[band] > POWER_FLOOR; }
+
+    /** @return Magnitude of the H1 transfer function estimate. */
+    double magnitude(int band) const;
+
+    /** @return Magnitude squared coherence between 0 and 1. */
+    double coherence(int band) const;
+
+    /** @return Averaged normalized power of the reference signal. */
+    double referencePower(int band) const { return _referencePower[band]; }
+
+    /** @return Averaged normalized power of the measured signal. */
+    double measuredPower(int band) const { return _measuredPower[band]; }
+
+private:
+    int _bands;
+    int _frameSize;
+
+    /** Averaged spectral densities of each bin. */
+    double _referenceDensity[MAX_BINS];
+    double _measuredDensity[MAX_BINS];
+    fftw_complex _crossDensity[MAX_BINS];
+
+    /** Averaged densities reduced to the bands. */
+    double _referencePower[ControlGrid::MAX_BANDS];
+    double _measuredPower[ControlGrid::MAX_BANDS];
+    /** Sum of the magnitudes of the cross densities of each band. */
+    double _crossMagnitude[ControlGrid::MAX_BANDS];
+    /** Reference power of each band weighted by the coherence of its bins. */
+    double _coherentPower[ControlGrid::MAX_BANDS];
+};
+
+#endif // SPECTRALESTIMATOR_H
@@ -0,0 +1,87 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "spectralsmoother.h"
+
+#include <cmath>
+
+SpectralSmoother::SpectralSmoother(int maximumSize) {
+    _maximumSize = maximumSize;
+    _size = 0;
+    _fraction = 0.0;
+    _lower = new int[maximumSize];
+    _upper = new int[maximumSize];
+    _prefixSum = new double[maximumSize + 1];
+}
+
+SpectralSmoother::~SpectralSmoother() {
+    delete[] _lower;
+    delete[] _upper;
+    delete[] _prefixSum;
+}
+
+void SpectralSmoother::setupLinear(int bins, double fraction) {
+    _size = bins < _maximumSize ? bins : _maximumSize;
+    _fraction = fraction;
+
+    // The window of a bin reaches half the fraction down and up, so
+    // bin k spans k / ratio .. k * ratio, but at least itself.
+    double ratio = pow(2.0, 0.5 / fraction);
+    for(int i = 0; i < _size; i++) {
+        int lower = (int)ceil(i / ratio);
+        int upper = (int)floor(i * ratio) + 1;
+        _lower[i] = lower < i ? lower : i;
+        _upper[i] = upper > i + 1 ? (upper < _size ? upper : _size) : i + 1;
+    }
+}
+
+void SpectralSmoother::setupLogarithmic(int bands, int bandsPerOctave, double fraction) {
+    _size = bands < _maximumSize ? bands : _maximumSize;
+    _fraction = fraction;
+
+    // On a logarithmic axis all windows have the same width, except where
+    // they are cut off at the ends.
+    int halfWidth = (int)floor(0.5 * bandsPerOctave / fraction + 0.5);
+    for(int i = 0; i < _size; i++) {
+        _lower[i] = i - halfWidth > 0 ? i - halfWidth : 0;
+        _upper[i] = i + halfWidth + 1 < _size ? i + halfWidth + 1 : _size;
+    }
+}
+
+void SpectralSmoother::smooth(const double *in, double *out) {
+    _prefixSum[0] = 0.0;
+    for(int i = 0; i < _size; i++)
+        _prefixSum[i + 1] = _prefixSum[i] + in[i];
+    average(out);
+}
+
+void SpectralSmoother::smoothPower(const double *in, double *out) {
+    _prefixSum[0] = 0.0;
+    for(int i = 0; i < _size; i++)
+        _prefixSum[i + 1] = _prefixSum[i] + in[i] * in[i];
+    average(out);
+    for(int i = 0; i < _size; i++)
+        out[i] = sqrt(out[i]);
+}
+
+void SpectralSmoother::average(double *out) {
+    for(int i = 0; i < _size; i++)
+        out[i] = (_prefixSum[_upper[i]] - _prefixSum[_lower[i]]) / (_upper[i] - _lower[i]);
+}
@@ -0,0 +1,102 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPECTRALSMOOTHER_H
+#define SPECTRALSMOOTHER_H
+
+/**
+ * @class SpectralSmoother
+ *
+ * @author Jacob Dawid ( jacob@omg-it.works )
+ * @author Otto Ritter ( otto.ritter.or@googlemail.com )
+ * @date 09.2011-2016
+ *
+ * @brief Fractional octave smoothing of spectra.
+ *
+ * Replaces every value by the average over a window that spans a fixed
+ * fraction of an octave around it. The window bounds are calculated once
+ * per setup, and the averages are taken as differences of a prefix sum,
+ * so smoothing costs O(N) regardless of the window widths. Works on
+ * linearly spaced FFT bins as well as on logarithmically spaced bands.
+ */
+class SpectralSmoother {
+public:
+    /**
+      * Constructs a new smoother.
+      * @param maximumSize Largest number of values that will be smoothed.
+      */
+    SpectralSmoother(int maximumSize);
+
+    /** Destructor. */
+    ~SpectralSmoother();
+
+    /**
+      * Sets up the windows for linearly spaced bins, the first bin being
+      * at 0 Hz.
+      * @param bins Number of bins.
+      * @param fraction Windows span 1/fraction of an octave.
+      */
+    void setupLinear(int bins, double fraction);
+
+    /**
+      * Sets up the windows for logarithmically spaced bands.
+      * @param bands Number of bands.
+      * @param bandsPerOctave Number of bands per octave.
+      * @param fraction Windows span 1/fraction of an octave.
+      */
+    void setupLogarithmic(int bands, int bandsPerOctave, double fraction);
+
+    /** @return The number of values the windows have been set up for. */
+    int size() const { return _size; }
+
+    /** @return Fraction of an octave the windows have been set up for. */
+    double fraction() const { return _fraction; }
+
+    /**
+      * Averages the values over the windows.
+      * @param in Values to smooth.
+      * @param out Receives the smoothed values, may be the same as in.
+      */
+    void smooth(const double *in, double *out);
+
+    /**
+      * Averages the power of magnitudes over the windows.
+      * @param in Magnitudes to smooth.
+      * @param out Receives the smoothed magnitudes, may be the same as in.
+      */
+    void smoothPower(const double *in, double *out);
+
+private:
+    /** Averages the prefix sums over the windows. */
+    void average(double *out);
+
+    int _maximumSize;
+    int _size;
+    double _fraction;
+
+    /** First index of each window. */
+    int *_lower;
+    /** Index after the last of each window. */
+    int *_upper;
+    /** Sum of all values before each index. */
+    double *_prefixSum;
+};
+
+#endif // SPECTRALSMOOTHER_H
@@ -0,0 +1,219 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "spectrumanalyzerwidget.h"
+
+#include <QPainter>
+#include <QPainterPath>
+
+#include <cmath>
+
+SpectrumAnalyzerWidget::SpectrumAnalyzerWidget(AnalyzerFeed *analyzerFeed, Equalizer *equalizer,
+                                               QWidget *parent) :
+    QWidget(parent),
+    _analyzerFeed(analyzerFeed),
+    _equalizer(equalizer) {
+    _frame.m_bands = 0;
+    _shownSnapshotVersion = -1;
+    _spectrogramVisible = false;
+    _spectrogramColumn = 0;
+
+    // Dark blue for silence over red to yellow for loud bands.
+    _colorMap.resize(256);
+    for(int i = 0; i < 256; i++) {
+        double x = i / 255.0;
+        int red = 255 * qMin(1.0, 2.0 * x);
+        int green = 255 * qMax(0.0, 2.0 * x - 1.0);
+        int blue = 255 * qMax(0.0, 0.4 - x);
+        _colorMap[i] = qRgb(red, green, blue);
+    }
+
+    setMinimumHeight(120);
+
+    _pollingTimer = new QTimer(this);
+    _pollingTimer->setInterval(FRAME_INTERVAL);
+    connect(_pollingTimer, SIGNAL(timeout()), this, SLOT(poll()));
+}
+
+void SpectrumAnalyzerWidget::setSpectrogramVisible(bool on) {
+    _spectrogramVisible = on;
+    update();
+}
+
+void SpectrumAnalyzerWidget::showEvent(QShowEvent *showEvent) {
+    _analyzerFeed->setActive(true);
+    _pollingTimer->start();
+    QWidget::showEvent(showEvent);
+}
+
+void SpectrumAnalyzerWidget::hideEvent(QHideEvent *hideEvent) {
+    _analyzerFeed->setActive(false);
+    _pollingTimer->stop();
+    QWidget::hideEvent(hideEvent);
+}
+
+void SpectrumAnalyzerWidget::poll() {
+    // Take every frame published since the last time, the curves show the
+    // latest one.
+    bool received = false;
+    bool gridChanged = false;
+    while(_analyzerFeed->readFrame(&_frame)) {
+        if(_frame.m_bandsPerOctave != _controlGrid.bandsPerOctave()
+        || _frame.m_sampleRate != _controlGrid.sampleRate()) {
+            _controlGrid.setup(_frame.m_bandsPerOctave, _frame.m_sampleRate);
+            gridChanged = true;
+        }
+        addSpectrogramColumn();
+        received = true;
+    }
+
+    // The filter is only designed anew when the controls change.
+    int snapshotVersion = _equalizer->snapshotVersion();
+    if(gridChanged || snapshotVersion != _shownSnapshotVersion) {
+        _shownSnapshotVersion = snapshotVersion;
+        _equalizer->readSnapshot(&_snapshot);
+        updateFilterResponse();
+        received = true;
+    }
+
+    if(received && !visibleRegion().isEmpty())
+        update();
+}
+
+void SpectrumAnalyzerWidget::addSpectrogramColumn() {
+    // Start over whenever the bands change.
+    if(_spectrogram.height() != _frame.m_bands) {
+        if(_frame.m_bands <= 0)
+            return;
+        _spectrogram = QImage(SPECTROGRAM_LENGTH, _frame.m_bands, QImage::Format_RGB32);
+        _spectrogram.fill(_colorMap[0]);
+        _spectrogramColumn = 0;
+    }
+
+    // The highest band is at the top.
+    for(int i = 0; i < _frame.m_bands; i++) {
+        double x = (_frame.m_measuredLevel[i] - MIN_LEVEL) / (double)(MAX_LEVEL - MIN_LEVEL);
+        int index = qBound(0, (int)(x * 255.0), 255);
+        QRgb *line = (QRgb*)_spectrogram.scanLine(_frame.m_bands - 1 - i);
+        line[_spectrogramColumn] = _colorMap[index];
+    }
+
+    if(++_spectrogramColumn == SPECTROGRAM_LENGTH)
+        _spectrogramColumn = 0;
+}
+
+void SpectrumAnalyzerWidget::updateFilterResponse() {
+    if(_snapshot.m_sampleRate <= 0)
+        return;
+
+    // A 201 tap filter cannot follow narrow bands at low frequencies, so
+    // its response may differ a lot from the controls.
+    for(int i = 0; i < _controlGrid.bands(); i++) {
+        double omega = 2.0 * M_PI * _controlGrid.frequency(i) / _snapshot.m_sampleRate;
+        double real = 0.0, imaginary = 0.0;
+        for(int n = 0; n < DSPKernels::FILTER_TAPS; n++) {
+            real += _snapshot.m_coefficients[n] * cos(omega * n);
+            imaginary -= _snapshot.m_coefficients[n] * sin(omega * n);
+        }
+
+        double power = real * real + imaginary * imaginary;
+        _filterLevel[i] = power > 0.0
+                ? qMax((float)(10.0 * log10(power)), AnalyzerFeed::LEVEL_FLOOR)
+                : AnalyzerFeed::LEVEL_FLOOR;
+    }
+}
+
+double SpectrumAnalyzerWidget::frequencyPosition(const QRect &rect, double frequency) {
+    double maxFrequency = _controlGrid.sampleRate() / 2.0;
+    return rect.left() + rect.width() * log(frequency / MIN_FREQUENCY)
+                                      / log(maxFrequency / MIN_FREQUENCY);
+}
+
+void SpectrumAnalyzerWidget::drawCurve(QPainter &painter, const QRect &rect, const float *levels,
+                                       double minLevel, double maxLevel, bool skipFloor) {
+    QPainterPath path;
+    bool drawing = false;
+    for(int i = 0; i < _frame.m_bands; i++) {
+        double frequency = _controlGrid.frequency(i);
+        if(frequency < MIN_FREQUENCY || (skipFloor && levels[i] <= AnalyzerFeed::LEVEL_FLOOR)) {
+            drawing = false;
+            continue;
+        }
+
+        double x = frequencyPosition(rect, frequency);
+        double level = qBound(minLevel, (double)levels[i], maxLevel);
+        double y = rect.bottom() - rect.height() * (level - minLevel) / (maxLevel - minLevel);
+        if(drawing) {
+            path.lineTo(x, y);
+        } else {
+            path.moveTo(x, y);
+            drawing = true;
+        }
+    }
+    painter.drawPath(path);
+}
+
+void SpectrumAnalyzerWidget::paintEvent(QPaintEvent *paintEvent) {
+    QPainter painter(this);
+    painter.fillRect(rect(), QColor(250, 250, 250));
+
+    QRect spectraRect = rect().adjusted(2, 2, -2, -2);
+    QRect spectrogramRect;
+    if(_spectrogramVisible) {
+        spectrogramRect = spectraRect;
+        spectraRect.setBottom(spectraRect.top() + spectraRect.height() * 3 / 5);
+        spectrogramRect.setTop(spectraRect.bottom() + 4);
+    }
+
+    // The spectrogram is drawn oldest column first, out of the two parts
+    // of the ring.
+    if(_spectrogramVisible && !_spectrogram.isNull()) {
+        int newer = _spectrogramColumn;
+        int older = SPECTROGRAM_LENGTH - newer;
+        double columnWidth = (double)spectrogramRect.width() / SPECTROGRAM_LENGTH;
+        QRectF olderRect(spectrogramRect.left(), spectrogramRect.top(),
+                         older * columnWidth, spectrogramRect.height());
+        QRectF newerRect(olderRect.right(), spectrogramRect.top(),
+                         newer * columnWidth, spectrogramRect.height());
+        painter.drawImage(olderRect, _spectrogram, QRectF(newer, 0, older, _spectrogram.height()));
+        painter.drawImage(newerRect, _spectrogram, QRectF(0, 0, newer, _spectrogram.height()));
+    }
+
+    if(_frame.m_bands <= 0 || _controlGrid.bands() != _frame.m_bands)
+        return;
+
+    painter.setRenderHints(QPainter::Antialiasing);
+
+    // The 0 dB line of the transfer function and the equalizer.
+    painter.setPen(QPen(QColor(0, 0, 0, 40), 1));
+    int center = spectraRect.center().y();
+    painter.drawLine(spectraRect.left(), center, spectraRect.right(), center);
+
+    painter.setPen(QPen(QColor(0, 122, 180, 160), 1));
+    drawCurve(painter, spectraRect, _frame.m_referenceLevel, MIN_LEVEL, MAX_LEVEL, false);
+    painter.setPen(QPen(QColor(180, 60, 0, 160), 1));
+    drawCurve(painter, spectraRect, _frame.m_measuredLevel, MIN_LEVEL, MAX_LEVEL, false);
+    painter.setPen(QPen(QColor(0, 140, 0, 220), 2));
+    drawCurve(painter, spectraRect, _frame.m_transferLevel, -RESPONSE_RANGE, RESPONSE_RANGE, true);
+    painter.setPen(QPen(QColor(0, 0, 40, 120), 2));
+    drawCurve(painter, spectraRect, _filterLevel, -RESPONSE_RANGE, RESPONSE_RANGE, false);
+
+    QWidget::paintEvent(paintEvent);
+}
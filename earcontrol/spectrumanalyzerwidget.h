@@ -0,0 +1,102 @@
+#ifndef SPECTRUMANALYZERWIDGET_H
+#define SPECTRUMANALYZERWIDGET_H
+
+#include <QWidget>
+#include <QImage>
+#include <QVector>
+#include <QTimer>
+
+#include <QPaintEvent>
+#include <QShowEvent>
+#include <QHideEvent>
+
+#include "analyzerfeed.h"
+#include "controlgrid.h"
+#include "equalizer.h"
+
+/**
+ * Live view of the spectra the adaption works with: the reference and the
+ * measured spectrum, the estimated transfer function and the response of
+ * the equalizer, optionally above a scrolling spectrogram of the measured
+ * signal. Frames are only published while the view is shown. New frames
+ * are drawn into a cached spectrogram image column by column, so repainting
+ * does not depend on the length of the history. The response of the
+ * equalizer is that of the filter actually designed, evaluated from the
+ * coefficients of its latest snapshot.
+ */
+class SpectrumAnalyzerWidget : public QWidget {
+    Q_OBJECT
+public:
+    explicit SpectrumAnalyzerWidget(AnalyzerFeed *analyzerFeed, Equalizer *equalizer,
+                                    QWidget *parent = 0);
+
+public slots:
+    /** Shows or hides the spectrogram below the spectra. */
+    void setSpectrogramVisible(bool on);
+
+protected:
+    void paintEvent(QPaintEvent *paintEvent);
+    void showEvent(QShowEvent *showEvent);
+    void hideEvent(QHideEvent *hideEvent);
+
+private slots:
+    void poll();
+
+private:
+    /** Interval between two repaints in milliseconds. */
+    static const int FRAME_INTERVAL = 1000 / AnalyzerFeed::FRAME_RATE;
+
+    /** Number of frames the spectrogram shows. */
+    static const int SPECTROGRAM_LENGTH = 10 * AnalyzerFeed::FRAME_RATE;
+
+    /** Range of the spectra in dB. */
+    static const int MIN_LEVEL = -90;
+    static const int MAX_LEVEL = 10;
+
+    /** Range of the transfer function and the equalizer response around
+      * 0 dB. */
+    static const int RESPONSE_RANGE = 24;
+
+    /** Lowest frequency shown. */
+    static const int MIN_FREQUENCY = 20;
+
+    /** Appends the measured spectrum of the frame to the spectrogram. */
+    void addSpectrogramColumn();
+
+    /** Draws one spectrum as a curve over the log frequency axis. */
+    void drawCurve(QPainter &painter, const QRect &rect, const float *levels,
+                   double minLevel, double maxLevel, bool skipFloor);
+
+    /** @return Horizontal position of a frequency in the rectangle. */
+    double frequencyPosition(const QRect &rect, double frequency);
+
+    /** Evaluates the response of the filter coefficients in the snapshot
+      * at the frequencies of the bands. */
+    void updateFilterResponse();
+
+    AnalyzerFeed *_analyzerFeed;
+    Equalizer *_equalizer;
+    QTimer *_pollingTimer;
+
+    /** Last snapshot of the equalizer and the version it has been taken at. */
+    Equalizer::ControlsSnapshot _snapshot;
+    int _shownSnapshotVersion;
+
+    /** Response of the designed filter in dB for each band of the frame. */
+    float _filterLevel[ControlGrid::MAX_BANDS];
+
+    /** Latest frame and the grid of its bands. */
+    AnalyzerFeed::Frame _frame;
+    ControlGrid _controlGrid;
+
+    bool _spectrogramVisible;
+
+    /** One column per frame and one row per band, written as a ring. */
+    QImage _spectrogram;
+    int _spectrogramColumn;
+
+    /** Colors of the levels in the spectrogram. */
+    QVector<QRgb> _colorMap;
+};
+
+#endif // SPECTRUMANALYZERWIDGET_H
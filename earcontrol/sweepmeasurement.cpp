@@ -0,0 +1,323 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sweepmeasurement.h"
+#include "fftwadapter.h"
+#include "semaphorelocker.h"
+
+#include <QtGlobal>
+#include <QDebug>
+
+#include <cmath>
+
+/** Amplitude of the sweep. */
+static const double SWEEP_AMPLITUDE = 0.5;
+
+/** Length of the fade at the end of the sweep. */
+static const int SWEEP_FADE_LENGTH = 256;
+
+/** Chunks the recording ring buffer holds, so that the worker thread may
+  * lag behind. */
+static const int RECORDING_BUFFER_CHUNKS = 8;
+
+const double SweepMeasurement::MAGNITUDE_SMOOTHING = 24.0;
+
+SweepMeasurement::SweepMeasurement(int sampleRate, double duration,
+                                   double startFrequency, double endFrequency) :
+    _magnitudeSmoother(TRANSFORM_SIZE / 2 + 1) {
+    _sampleRate = sampleRate;
+    _sweepLength = (int)(duration * sampleRate);
+    _startFrequency = startFrequency;
+    _endFrequency = endFrequency;
+
+    _startOmega = 2.0 * M_PI * startFrequency / sampleRate;
+    double endOmega = 2.0 * M_PI * endFrequency / sampleRate;
+    _sweepRate = _sweepLength / log(endOmega / _startOmega);
+
+    _recordingRingBuffer = jack_ringbuffer_create(
+        RECORDING_BUFFER_CHUNKS * CHUNK_SIZE * sizeof(jack_default_audio_sample_t));
+    jack_ringbuffer_mlock(_recordingRingBuffer);
+    _overrun.store(false);
+    _finished.store(false);
+
+    // The sweep stays at each frequency for a time proportional to its
+    // inverse, so its energy spectrum is pink. The inverse filter tilts
+    // it back to white, which leaves this constant as the overall gain.
+    _inverseGain = 2.0 * endOmega / (M_PI * _sweepRate * SWEEP_AMPLITUDE);
+
+    _chunk = new jack_default_audio_sample_t[CHUNK_SIZE];
+    _packed = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * TRANSFORM_SIZE);
+    _packedTransform = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * TRANSFORM_SIZE);
+    _recordingSpectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * (TRANSFORM_SIZE / 2 + 1));
+    _filterSpectrum = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * (TRANSFORM_SIZE / 2 + 1));
+    _convolution = (double*)fftw_malloc(sizeof(double) * TRANSFORM_SIZE);
+    _impulseResponse = new double[IMPULSE_RESPONSE_LENGTH];
+    _magnitudeResponse = new double[TRANSFORM_SIZE / 2 + 1];
+    _smoothedMagnitudeResponse = new double[TRANSFORM_SIZE / 2 + 1];
+
+    for(int i = 0; i < IMPULSE_RESPONSE_LENGTH; i++)
+        _impulseResponse[i] = 0.0;
+    for(int i = 0; i <= TRANSFORM_SIZE / 2; i++) {
+        _magnitudeResponse[i] = 0.0;
+        _smoothedMagnitudeResponse[i] = 0.0;
+    }
+    _magnitudeSmoother.setupLinear(TRANSFORM_SIZE / 2 + 1, MAGNITUDE_SMOOTHING);
+
+    {
+        SemaphoreLocker locker(FFTWAdapter::plannerSemaphore());
+        Q_UNUSED(locker);
+        _forwardPlan = fftw_plan_dft_1d(TRANSFORM_SIZE, _packed, _packedTransform,
+                                        FFTW_FORWARD, FFTW_ESTIMATE);
+        _inversePlan = fftw_plan_dft_c2r_1d(TRANSFORM_SIZE, _recordingSpectrum,
+                                            _convolution, FFTW_ESTIMATE);
+    }
+
+    _windowStart = 0;
+    _recordingLength = 0;
+    _position = 0;
+    _chunkFill = 0;
+    _chunkStart = 0;
+}
+
+SweepMeasurement::~SweepMeasurement() {
+    stop();
+    jack_ringbuffer_free(_recordingRingBuffer);
+
+    {
+        SemaphoreLocker locker(FFTWAdapter::plannerSemaphore());
+        Q_UNUSED(locker);
+        fftw_destroy_plan(_forwardPlan);
+        fftw_destroy_plan(_inversePlan);
+    }
+    fftw_free(_packed);
+    fftw_free(_packedTransform);
+    fftw_free(_recordingSpectrum);
+    fftw_free(_filterSpectrum);
+    fftw_free(_convolution);
+    delete[] _chunk;
+    delete[] _impulseResponse;
+    delete[] _magnitudeResponse;
+    delete[] _smoothedMagnitudeResponse;
+}
+
+int SweepMeasurement::sampleRate() const {
+    return _sampleRate;
+}
+
+void SweepMeasurement::start(int windowOffset) {
+    stop();
+
+    // The linear impulse response appears at the end of the sweep, earlier
+    // output samples contain the harmonic distortion.
+    _windowStart = _sweepLength - 1 + windowOffset;
+    _recordingLength = _windowStart + IMPULSE_RESPONSE_LENGTH;
+    _position = 0;
+    _chunkFill = 0;
+    _chunkStart = 0;
+
+    for(int i = 0; i < IMPULSE_RESPONSE_LENGTH; i++)
+        _impulseResponse[i] = 0.0;
+
+    // Drop whatever is left of an earlier measurement.
+    jack_ringbuffer_read_advance(_recordingRingBuffer,
+                                 jack_ringbuffer_read_space(_recordingRingBuffer));
+    _overrun.store(false);
+    _finished.store(false);
+
+    QThread::start(QThread::LowPriority);
+}
+
+bool SweepMeasurement::process(const jack_default_audio_sample_t *measured,
+                               jack_default_audio_sample_t *out, int samples) {
+    for(int i = 0; i < samples; i++)
+        out[i] = SWEEP_AMPLITUDE * sweep(_position + i);
+
+    int count = qBound(0, _recordingLength - _position, samples);
+    if(count > 0) {
+        size_t size = count * sizeof(jack_default_audio_sample_t);
+        if(jack_ringbuffer_write_space(_recordingRingBuffer) >= size)
+            jack_ringbuffer_write(_recordingRingBuffer, (const char*)measured, size);
+        else
+            _overrun.store(true);
+        _position += count;
+    }
+
+    return _finished.loadAcquire();
+}
+
+void SweepMeasurement::run() {
+    while(!isInterruptionRequested()) {
+        int remaining = _recordingLength - _chunkStart - _chunkFill;
+        if(remaining == 0 || _overrun.load())
+            break;
+
+        int available = jack_ringbuffer_read_space(_recordingRingBuffer)
+                      / sizeof(jack_default_audio_sample_t);
+        if(available == 0) {
+            msleep(10);
+            continue;
+        }
+
+        int count = qMin(qMin(available, remaining), CHUNK_SIZE - _chunkFill);
+        jack_ringbuffer_read(_recordingRingBuffer, (char*)(_chunk + _chunkFill),
+                             count * sizeof(jack_default_audio_sample_t));
+        _chunkFill += count;
+
+        if(_chunkFill == CHUNK_SIZE) {
+            deconvolveChunk();
+            _chunkStart += CHUNK_SIZE;
+            _chunkFill = 0;
+        }
+    }
+
+    if(isInterruptionRequested())
+        return;
+
+    // Samples are missing, the worker fell too far behind. The response
+    // recovered so far is reported anyway.
+    if(_overrun.load())
+        qDebug() << "Sweep measurement dropped samples, the impulse response is incomplete.";
+
+    if(_chunkFill > 0) {
+        for(int i = _chunkFill; i < CHUNK_SIZE; i++)
+            _chunk[i] = 0.0f;
+        deconvolveChunk();
+        _chunkStart += CHUNK_SIZE;
+        _chunkFill = 0;
+    }
+
+    analyzeImpulseResponse();
+    _finished.storeRelease(true);
+}
+
+void SweepMeasurement::stop() {
+    requestInterruption();
+    wait();
+}
+
+const double *SweepMeasurement::impulseResponse() const {
+    return _impulseResponse;
+}
+
+const double *SweepMeasurement::magnitudeResponse() const {
+    return _magnitudeResponse;
+}
+
+const double *SweepMeasurement::smoothedMagnitudeResponse() const {
+    return _smoothedMagnitudeResponse;
+}
+
+void SweepMeasurement::controlMagnitudes(const ControlGrid &controlGrid, double *magnitudes) const {
+    int bands = controlGrid.bands();
+    ControlGrid::BinRange ranges[ControlGrid::MAX_BANDS];
+    controlGrid.binRanges((double)_sampleRate / TRANSFORM_SIZE, TRANSFORM_SIZE / 2 + 1, ranges);
+
+    // The response rolls off towards the ends of the sweep, so keep a third
+    // of an octave away from them.
+    const double margin = pow(2.0, 1.0 / 3.0);
+    int first = 0, last = bands - 1;
+    while(first < bands - 1 && controlGrid.frequency(first) < _startFrequency * margin)
+        first++;
+    while(last > first && controlGrid.frequency(last) > _endFrequency / margin)
+        last--;
+
+    // The smoothed response keeps the low bands, which are narrower than
+    // a bin, from following single bins.
+    for(int i = first; i <= last; i++) {
+        // Average the power of all bins of the band.
+        double power = 0.0;
+        for(int j = ranges[i].first; j <= ranges[i].last; j++)
+            power += _smoothedMagnitudeResponse[j] * _smoothedMagnitudeResponse[j];
+        magnitudes[i] = sqrt(power / (ranges[i].last - ranges[i].first + 1));
+    }
+
+    for(int i = 0; i < first; i++)
+        magnitudes[i] = magnitudes[first];
+    for(int i = last + 1; i < bands; i++)
+        magnitudes[i] = magnitudes[last];
+}
+
+double SweepMeasurement::sweep(int index) const {
+    if(index < 0 || index >= _sweepLength)
+        return 0.0;
+
+    double value = sin(_startOmega * _sweepRate * (exp(index / _sweepRate) - 1.0));
+
+    // Fade out to avoid a click at the end of the sweep.
+    int remaining = _sweepLength - 1 - index;
+    if(remaining < SWEEP_FADE_LENGTH)
+        value *= 0.5 - 0.5 * cos(M_PI * remaining / SWEEP_FADE_LENGTH);
+    return value;
+}
+
+double SweepMeasurement::inverseFilter(int index) const {
+    if(index < 0 || index >= _sweepLength)
+        return 0.0;
+
+    // Time reversed sweep, attenuated by 6 dB per octave towards the
+    // lower frequencies.
+    return _inverseGain * sweep(_sweepLength - 1 - index) * exp(-index / _sweepRate);
+}
+
+void SweepMeasurement::deconvolveChunk() {
+    // The window needs the inverse filter between these indices for the
+    // samples of this chunk, so only this segment is calculated.
+    int segmentStart = _windowStart - _chunkStart - CHUNK_SIZE + 1;
+    int segmentLength = IMPULSE_RESPONSE_LENGTH + CHUNK_SIZE - 1;
+
+    // Both signals are real, so transform them together.
+    for(int i = 0; i < TRANSFORM_SIZE; i++) {
+        _packed[i][0] = i < CHUNK_SIZE ? _chunk[i] : 0.0;
+        _packed[i][1] = i < segmentLength ? inverseFilter(segmentStart + i) : 0.0;
+    }
+    fftw_execute(_forwardPlan);
+    FFTWAdapter::separateSpectra(_packedTransform, _recordingSpectrum,
+                                 _filterSpectrum, TRANSFORM_SIZE);
+
+    for(int i = 0; i <= TRANSFORM_SIZE / 2; i++) {
+        double real = _recordingSpectrum[i][0] * _filterSpectrum[i][0]
+                    - _recordingSpectrum[i][1] * _filterSpectrum[i][1];
+        double imaginary = _recordingSpectrum[i][0] * _filterSpectrum[i][1]
+                         + _recordingSpectrum[i][1] * _filterSpectrum[i][0];
+        _recordingSpectrum[i][0] = real;
+        _recordingSpectrum[i][1] = imaginary;
+    }
+    fftw_execute(_inversePlan);
+
+    // The window is the part of the linear convolution where the chunk
+    // overlaps the segment completely.
+    for(int i = 0; i < IMPULSE_RESPONSE_LENGTH; i++)
+        _impulseResponse[i] += _convolution[i + CHUNK_SIZE - 1] / TRANSFORM_SIZE;
+}
+
+void SweepMeasurement::analyzeImpulseResponse() {
+    for(int i = 0; i < TRANSFORM_SIZE; i++) {
+        _packed[i][0] = i < IMPULSE_RESPONSE_LENGTH ? _impulseResponse[i] : 0.0;
+        _packed[i][1] = 0.0;
+    }
+    fftw_execute(_forwardPlan);
+
+    for(int i = 0; i <= TRANSFORM_SIZE / 2; i++) {
+        _magnitudeResponse[i] = sqrt(_packedTransform[i][0] * _packedTransform[i][0]
+                                   + _packedTransform[i][1] * _packedTransform[i][1]);
+    }
+
+    _magnitudeSmoother.smoothPower(_magnitudeResponse, _smoothedMagnitudeResponse);
+}
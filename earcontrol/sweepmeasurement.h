@@ -0,0 +1,197 @@
+/* This file is part of EAR, an audio processing tool.
+ *
+ * Copyright (C) 2011-2016 Otto Ritter, Jacob Dawid
+ * otto.ritter.or@googlemail.com
+ * jacob@omg-it.works
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the Affero GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the Affero GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SWEEPMEASUREMENT_H
+#define SWEEPMEASUREMENT_H
+
+#include <QThread>
+#include <QAtomicInt>
+
+// JACK includes:
+#include <jack/jack.h>
+#include <jack/ringbuffer.h>
+
+// FFTW3 includes:
+#include "fftw3.h"
+
+#include "controlgrid.h"
+#include "spectralsmoother.h"
+
+/**
+ * @class SweepMeasurement
+ *
+ * @author Jacob Dawid ( jacob@omg-it.works )
+ * @author Otto Ritter ( otto.ritter.or@googlemail.com )
+ * @date 09.2011-2016
+ *
+ * @brief Measures an impulse response with an exponential sine sweep.
+ *
+ * Plays an exponential sine sweep and convolves the recording with the
+ * inverse filter of the sweep, which yields the impulse response. The
+ * recording is deconvolved in chunks while it arrives and the inverse
+ * filter is calculated for each chunk, so the memory needed does not
+ * depend on the length of the sweep. Only a window of the impulse
+ * response around the expected arrival of the direct sound is kept.
+ *
+ * Deconvolving a chunk takes too long for a period. The process callback
+ * only plays the sweep and hands the recording over to a worker thread
+ * through a lock-free ring buffer.
+ */
+class SweepMeasurement : public QThread {
+    Q_OBJECT
+public:
+    /** Length of the impulse response window in samples. */
+    static const int IMPULSE_RESPONSE_LENGTH = 32768;
+
+    /** Number of recorded samples deconvolved at once. */
+    static const int CHUNK_SIZE = 16384;
+
+    /** Size of the transforms, large enough to avoid circular aliasing. */
+    static const int TRANSFORM_SIZE = 65536;
+
+    /** The smoothed magnitude response is averaged over this fraction of
+      * an octave. */
+    static const double MAGNITUDE_SMOOTHING;
+
+    /**
+      * Constructs a new sweep measurement.
+      * @param sampleRate Sample rate in Hz.
+      * @param duration Duration of the sweep in seconds.
+      * @param startFrequency Frequency the sweep starts at in Hz.
+      * @param endFrequency Frequency the sweep ends at in Hz.
+      */
+    SweepMeasurement(int sampleRate, double duration,
+                     double startFrequency, double endFrequency);
+
+    /** Destructor. Stops the worker thread. */
+    ~SweepMeasurement();
+
+    /** @return The sample rate this measurement has been set up for. */
+    int sampleRate() const;
+
+    /**
+      * Prepares a new measurement and starts the worker thread. Do not call
+      * from the process callback.
+      * @param windowOffset Delay in samples the impulse response window
+      *        starts at.
+      */
+    void start(int windowOffset);
+
+    /**
+      * Processes one period. Writes the sweep, or silence after it, and
+      * hands the recording over to the worker thread. Safe to call from
+      * the process callback.
+      * @param measured Recorded samples.
+      * @param out Receives the excitation.
+      * @param samples Number of samples.
+      * @return true, once the worker thread has finished the measurement.
+      */
+    bool process(const jack_default_audio_sample_t *measured,
+                 jack_default_audio_sample_t *out, int samples);
+
+    /** @return The measured impulse response of IMPULSE_RESPONSE_LENGTH
+      *         samples. The first sample is at the window offset. */
+    const double *impulseResponse() const;
+
+    /** @return The magnitude response of the impulse response window,
+      *         TRANSFORM_SIZE / 2 + 1 bins. */
+    const double *magnitudeResponse() const;
+
+    /** @return The magnitude response smoothed over MAGNITUDE_SMOOTHING
+      *         of an octave, TRANSFORM_SIZE / 2 + 1 bins. */
+    const double *smoothedMagnitudeResponse() const;
+
+    /**
+      * Averages the smoothed magnitude response over the bands of the controls.
+      * Bands outside of the swept range take the value of the nearest band
+      * inside.
+      * @param controlGrid Bands of the controls.
+      * @param magnitudes Receives the magnitude for each band.
+      */
+    void controlMagnitudes(const ControlGrid &controlGrid, double *magnitudes) const;
+
+protected:
+    /** Reimplemented from QThread. */
+    void run();
+
+private:
+    /** Stops the worker thread. */
+    void stop();
+
+    /** @return Sample of the sweep at the given index. */
+    double sweep(int index) const;
+
+    /** @return Sample of the inverse filter at the given index. */
+    double inverseFilter(int index) const;
+
+    /** Deconvolves the recorded chunk into the impulse response window. */
+    void deconvolveChunk();
+
+    /** Calculates the magnitude response of the impulse response. */
+    void analyzeImpulseResponse();
+
+    int _sampleRate;
+    int _sweepLength;
+    double _startFrequency;
+    double _endFrequency;
+
+    /** Start frequency in radians per sample. */
+    double _startOmega;
+    /** Time constant of the sweep in samples. */
+    double _sweepRate;
+    /** Scales the inverse filter to unity gain. */
+    double _inverseGain;
+
+    /** Output index the impulse response window starts at. */
+    int _windowStart;
+    /** Samples to record, until the last sample of the window has been
+      * affected. */
+    int _recordingLength;
+    /** Samples played and recorded so far, owned by the process callback. */
+    int _position;
+    /** Samples in the chunk buffer, owned by the worker thread. */
+    int _chunkFill;
+    /** Recording index of the first sample in the chunk buffer. */
+    int _chunkStart;
+
+    /** Recording handed over to the worker thread. */
+    jack_ringbuffer_t *_recordingRingBuffer;
+    /** Set when the process callback had to drop samples. */
+    QAtomicInt _overrun;
+    /** Set by the worker thread once the results are complete. */
+    QAtomicInt _finished;
+
+    jack_default_audio_sample_t *_chunk;
+    fftw_complex *_packed;
+    fftw_complex *_packedTransform;
+    fftw_complex *_recordingSpectrum;
+    fftw_complex *_filterSpectrum;
+    double *_convolution;
+    double *_impulseResponse;
+    double *_magnitudeResponse;
+    double *_smoothedMagnitudeResponse;
+
+    SpectralSmoother _magnitudeSmoother;
+
+    fftw_plan _forwardPlan;
+    fftw_plan _inversePlan;
+};
+
+#endif // SWEEPMEASUREMENT_H